@@ -0,0 +1,154 @@
+#include "Arena.hpp"
+
+#include <new>
+#include <algorithm>
+#include <sys/mman.h>
+
+
+namespace ai_assignment
+{
+    // Public Constructors
+
+
+    Arena::Arena(const Options &options)
+        : m_Options(options)
+    {}
+
+    Arena::~Arena() noexcept
+    {
+        for (auto &region : this->m_Regions)
+        {
+            munmap(region.start, region.size);
+        }
+    }
+
+
+    // Public Accessors
+
+
+    size_t Arena::Footprint() const noexcept
+    {
+        auto scopedLock = std::scoped_lock(this->m_Lock);
+
+        size_t total = 0;
+
+        for (auto &region : this->m_Regions) total += region.size;
+
+        return total;
+    }
+
+    size_t Arena::Used() const noexcept
+    {
+        auto scopedLock = std::scoped_lock(this->m_Lock);
+
+        size_t total = 0;
+
+        for (auto &region : this->m_Regions) total += region.used;
+
+        return total - this->m_FreeBytes;
+    }
+
+    size_t Arena::HugePageBytes() const noexcept
+    {
+        auto scopedLock = std::scoped_lock(this->m_Lock);
+
+        size_t total = 0;
+
+        for (auto &region : this->m_Regions)
+        {
+            if (region.hugePages) total += region.size;
+        }
+
+        return total;
+    }
+
+
+    // Public Functions
+
+
+    void *Arena::Allocate(size_t bytes)
+    {
+        // Keep every block on its own cache lines
+        bytes = (bytes + Alignment - 1) / Alignment * Alignment;
+
+        auto scopedLock = std::scoped_lock(this->m_Lock);
+
+        // Prefer recycling a block of the same size
+        auto freeBlocks = this->m_FreeBlocks.find(bytes);
+
+        if (freeBlocks != this->m_FreeBlocks.end() && !freeBlocks->second.empty())
+        {
+            void *block = freeBlocks->second.back();
+            freeBlocks->second.pop_back();
+            this->m_FreeBytes -= bytes;
+
+            return block;
+        }
+
+        if (this->m_Regions.empty() || this->m_Regions.back().size - this->m_Regions.back().used < bytes)
+        {
+            this->MapRegion(bytes);
+        }
+
+        auto &region = this->m_Regions.back();
+
+        // Fresh anonymous mappings are already zeroed by the OS
+        void *block = region.start + region.used;
+        region.used += bytes;
+
+        return block;
+    }
+
+
+    void Arena::Release(void *block, size_t bytes) noexcept
+    {
+        if (block == nullptr) return;
+
+        bytes = (bytes + Alignment - 1) / Alignment * Alignment;
+
+        auto scopedLock = std::scoped_lock(this->m_Lock);
+
+        this->m_FreeBlocks[bytes].push_back(block);
+        this->m_FreeBytes += bytes;
+    }
+
+
+    // Protected Functions
+
+
+    void Arena::MapRegion(size_t minimumSize)
+    {
+        size_t size = std::max(minimumSize, this->m_Options.regionSize);
+        bool hugePages = (this->m_Options.hugePages != HugePages::None);
+
+        // Huge pages are only used when the whole mapping is made of them
+        size_t pageSize = hugePages ? HugePageSize : 4096;
+        size = (size + pageSize - 1) / pageSize * pageSize;
+
+        void *start = MAP_FAILED;
+
+        if (this->m_Options.hugePages == HugePages::Explicit)
+        {
+            // Fails when the administrator hasn't reserved any huge pages, in which case we try transparent ones
+            start = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+
+        if (start == MAP_FAILED)
+        {
+            start = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+            if (start == MAP_FAILED) throw std::bad_alloc();
+
+            // Only advisory, so a kernel without THP support just ignores us
+            if (hugePages && madvise(start, size, MADV_HUGEPAGE) != 0) hugePages = false;
+        }
+
+        this->m_Regions.push_back({
+            .start = static_cast<char*>(start),
+            .size = size,
+            .used = 0,
+            .hugePages = hugePages
+        });
+    }
+
+} // End namespace ai_assignment
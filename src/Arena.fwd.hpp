@@ -0,0 +1,12 @@
+#pragma once
+#ifndef FWD_H_530093_SRC_ARENA
+#define FWD_H_530093_SRC_ARENA 1
+
+namespace ai_assignment
+{
+    class Arena;
+
+} // End namespace ai_assignment
+
+
+#endif // FWD_H_530093_SRC_ARENA
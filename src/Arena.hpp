@@ -0,0 +1,194 @@
+#pragma once
+#ifndef H_530093_SRC_ARENA
+#define H_530093_SRC_ARENA 1
+
+#include "Arena.fwd.hpp"
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+
+namespace ai_assignment
+{
+    /**
+     * @brief A region based allocator which hands out 64-byte aligned blocks. Memory is only returned to the OS when the arena is destroyed, released blocks are recycled for allocations of the same size. Thread safe
+     */
+    class Arena
+    {
+        public:
+
+            // Definitions
+
+            /**
+             * @brief How the arena should try to back its memory with huge pages
+             */
+            enum class HugePages
+            {
+                // Regular pages
+                None,
+                // Ask for transparent huge pages with madvise(MADV_HUGEPAGE)
+                Transparent,
+                // Ask for reserved huge pages with MAP_HUGETLB, falling back to transparent huge pages if there are none
+                Explicit
+            };
+
+            struct Options
+            {
+                /**
+                 * @brief The minimum size of each region mapped from the OS. Zero sizes regions to fit the first allocation made in them
+                 */
+                size_t regionSize = 0;
+
+                HugePages hugePages = HugePages::None;
+            };
+
+            /**
+             * @brief The alignment of every block, matches a cache line
+             */
+            static constexpr size_t Alignment = 64;
+
+            /**
+             * @brief The size of a huge page on x86-64 and aarch64 (with 4K base pages)
+             */
+            static constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+
+            // Constructors
+
+
+            /**
+             * @brief Construct a new, empty Arena using regular pages. No memory is mapped until the first allocation
+             */
+            inline Arena()
+                : Arena(Options())
+            {}
+
+            /**
+             * @brief Construct a new, empty Arena. No memory is mapped until the first allocation
+             *
+             * @param options How to map memory from the OS
+             */
+            Arena(const Options &options);
+
+            /**
+             * @brief Releases every region back to the OS. Any pointers handed out are invalidated
+             */
+            virtual ~Arena() noexcept;
+
+            // An arena owns raw memory, copies would double free
+            Arena(const Arena &obj) = delete;
+            Arena &operator=(const Arena &obj) = delete;
+
+            // Accessors
+
+            /**
+             * @brief The options the arena was created with
+             */
+            inline const Options &GetOptions() const noexcept
+            {
+                return this->m_Options;
+            }
+
+            /**
+             * @brief The total number of bytes mapped from the OS
+             */
+            size_t Footprint() const noexcept;
+
+            /**
+             * @brief The number of bytes which are currently handed out, including alignment padding
+             */
+            size_t Used() const noexcept;
+
+            /**
+             * @brief The number of mapped bytes which are backed by (or have been advised to use) huge pages
+             */
+            size_t HugePageBytes() const noexcept;
+
+            /**
+             * @brief Rounds a number of elements up so that a row of them fills whole cache lines
+             */
+            template<typename T>
+            static inline constexpr size_t AlignedCount(size_t count) noexcept
+            {
+                constexpr size_t perLine = Alignment / sizeof(T);
+
+                return (count + perLine - 1) / perLine * perLine;
+            }
+
+            // Functions
+
+            /**
+             * @brief Hands out a 64-byte aligned block. New blocks are zeroed, recycled blocks keep the contents they were released with
+             *
+             * @param bytes The size of the block. Rounded up to a multiple of the alignment
+             * @return void* The start of the block
+             */
+            void *Allocate(size_t bytes);
+
+            /**
+             * @brief Hands out a 64-byte aligned block for count values of T
+             */
+            template<typename T>
+            inline T *Allocate(size_t count)
+            {
+                return static_cast<T*>(this->Allocate(count * sizeof(T)));
+            }
+
+            /**
+             * @brief Returns a block so a later allocation of the same size can reuse it
+             *
+             * @param block The start of the block, as returned by Allocate
+             * @param bytes The size the block was allocated with
+             */
+            void Release(void *block, size_t bytes) noexcept;
+
+        protected:
+
+            // Definitions
+
+            struct Region
+            {
+                char *start;
+                size_t size;
+                size_t used;
+                bool hugePages;
+            };
+
+            // Properties
+
+            const Options m_Options;
+
+            /**
+             * @brief The regions mapped so far, allocations are made from the back one
+             */
+            std::vector<Region> m_Regions;
+
+            /**
+             * @brief Released blocks, by their (aligned) size
+             */
+            std::map<size_t, std::vector<void*>> m_FreeBlocks;
+
+            /**
+             * @brief The number of bytes sitting in m_FreeBlocks
+             */
+            size_t m_FreeBytes = 0;
+
+            /**
+             * @brief A mutex to guard m_Regions and m_FreeBlocks
+             */
+            mutable std::mutex m_Lock;
+
+            // Functions
+
+            /**
+             * @brief Maps a new region from the OS which can hold at least minimumSize bytes
+             */
+            void MapRegion(size_t minimumSize);
+    };
+
+} // End namespace ai_assignment
+
+
+#endif // H_530093_SRC_ARENA
@@ -0,0 +1,396 @@
+#include "Autotuner.hpp"
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+#include <algorithm>
+#include <sstream>
+#include <fstream>
+#include <cstdlib>
+#include <stdexcept>
+#include <filesystem>
+#include <unistd.h>
+
+#include "Trace.hpp"
+#include "Executor.hpp"
+
+
+namespace ai_assignment
+{
+    namespace
+    {
+        /**
+         * @brief Neurons [first, last) one at a time
+         */
+        void scalarRows(const Autotuner::Shape &shape, size_t first, size_t last, const double *weights, const double *inputs, double *outputs, const Autotuner::activation_func_type &activation)
+        {
+            for (size_t j = first; j < last; j++)
+            {
+                const double *row = weights + j * shape.stride;
+
+                for (size_t b = 0; b < shape.batch; b++)
+                {
+                    const double *x = inputs + b * shape.stride;
+                    double net = 0.0;
+
+                    for (size_t k = 0; k < shape.inputs; k++)
+                    {
+                        net += x[k] * row[k];
+                    }
+
+                    outputs[b * shape.stride + j] = activation(net);
+                }
+            }
+        }
+
+        /**
+         * @brief Neurons [first, last) four at a time. Each sum is still taken in input order, so the results match scalarRows exactly
+         */
+        void blockedRows(const Autotuner::Shape &shape, size_t first, size_t last, const double *weights, const double *inputs, double *outputs, const Autotuner::activation_func_type &activation)
+        {
+            size_t j = first;
+
+            for (; j + 4 <= last; j += 4)
+            {
+                const double *row0 = weights + j * shape.stride;
+                const double *row1 = row0 + shape.stride;
+                const double *row2 = row1 + shape.stride;
+                const double *row3 = row2 + shape.stride;
+
+                for (size_t b = 0; b < shape.batch; b++)
+                {
+                    const double *x = inputs + b * shape.stride;
+                    double net0 = 0.0, net1 = 0.0, net2 = 0.0, net3 = 0.0;
+
+                    for (size_t k = 0; k < shape.inputs; k++)
+                    {
+                        double value = x[k];
+
+                        net0 += value * row0[k];
+                        net1 += value * row1[k];
+                        net2 += value * row2[k];
+                        net3 += value * row3[k];
+                    }
+
+                    double *out = outputs + b * shape.stride + j;
+
+                    out[0] = activation(net0);
+                    out[1] = activation(net1);
+                    out[2] = activation(net2);
+                    out[3] = activation(net3);
+                }
+            }
+
+            scalarRows(shape, j, last, weights, inputs, outputs, activation);
+        }
+
+        /**
+         * @brief The number of neurons in each task of the threaded kernel
+         */
+        constexpr size_t ThreadedBlock = 16;
+
+        std::mutex defaultLock;
+        std::unique_ptr<Autotuner> defaultAutotuner;
+        Autotuner::Options defaultOptions;
+
+        /**
+         * @brief The CPU model from /proc/cpuinfo, which names it differently on different architectures
+         */
+        std::string cpuModel()
+        {
+            auto file = std::ifstream("/proc/cpuinfo");
+            auto line = std::string();
+
+            for (const char *key : { "model name", "Model", "Hardware", "cpu model", "CPU part" })
+            {
+                file.clear();
+                file.seekg(0);
+
+                while (std::getline(file, line))
+                {
+                    if (line.rfind(key, 0) != 0) continue;
+
+                    size_t colon = line.find(':');
+
+                    if (colon == std::string::npos) continue;
+
+                    auto model = line.substr(line.find_first_not_of(" \t", colon + 1));
+
+                    // Tabs separate the fields of the cache file
+                    std::replace(model.begin(), model.end(), '\t', ' ');
+
+                    return model;
+                }
+            }
+
+            return "unknown";
+        }
+
+    } // End anonymous namespace
+
+
+    // Public Constructors
+
+
+    Autotuner::Autotuner(const Options &options)
+        : m_Options(options),
+            m_Host(options.enabled? cpuModel() + " / " + std::to_string(Executor::DefaultThreadCount()) + " threads" : ""),
+            m_CacheFile(options.cacheFile.empty()? Autotuner::DefaultCacheFile() : options.cacheFile)
+    {
+        if (options.enabled) this->Load();
+    }
+
+    Autotuner &Autotuner::Default()
+    {
+        auto scopedLock = std::scoped_lock(defaultLock);
+
+        if (!defaultAutotuner) defaultAutotuner = std::make_unique<Autotuner>(defaultOptions);
+
+        return *defaultAutotuner;
+    }
+
+    void Autotuner::SetDefaultOptions(const Options &options)
+    {
+        auto scopedLock = std::scoped_lock(defaultLock);
+
+        if (defaultAutotuner) throw std::logic_error("The default autotuner has already been created");
+
+        defaultOptions = options;
+    }
+
+
+    // Public Accessors
+
+
+    Autotuner::Stats Autotuner::GetStats() const
+    {
+        auto scopedLock = std::scoped_lock(this->m_Lock);
+
+        return this->m_Stats;
+    }
+
+
+    // Public Functions
+
+
+    Autotuner::Kernel Autotuner::Choose(const Shape &shape)
+    {
+        if (!this->m_Options.enabled) return Kernel::Scalar;
+
+        {
+            auto scopedLock = std::scoped_lock(this->m_Lock);
+
+            auto found = this->m_Choices.find(shape);
+
+            if (found != this->m_Choices.end())
+            {
+                this->m_Stats.cached++;
+
+                return found->second;
+            }
+        }
+
+        // Time without holding the lock, the threaded kernel's loops may run other tasks while they wait, which may be choosing kernels too
+        Kernel kernel = this->Tune(shape);
+        auto choices = std::map<Shape, Kernel>();
+
+        {
+            auto scopedLock = std::scoped_lock(this->m_Lock);
+
+            auto [found, inserted] = this->m_Choices.emplace(shape, kernel);
+
+            // Another thread timed the same shape meanwhile, keep its choice so every net agrees
+            if (!inserted)
+            {
+                this->m_Stats.cached++;
+
+                return found->second;
+            }
+
+            this->m_Stats.tuned++;
+
+            choices = this->m_Choices;
+        }
+
+        this->Save(choices);
+
+        return kernel;
+    }
+
+    void Autotuner::Run(Kernel kernel, const Shape &shape, const double *weights, const double *inputs, double *outputs, const activation_func_type &activation)
+    {
+        switch (kernel)
+        {
+            case Kernel::Scalar:
+                scalarRows(shape, 0, shape.neurons, weights, inputs, outputs, activation);
+                break;
+
+            case Kernel::Blocked:
+                blockedRows(shape, 0, shape.neurons, weights, inputs, outputs, activation);
+                break;
+
+            case Kernel::Threaded:
+            {
+                size_t blocks = (shape.neurons + ThreadedBlock - 1) / ThreadedBlock;
+
+                Executor::Default().ParallelFor(blocks, [&](size_t block)
+                {
+                    size_t first = block * ThreadedBlock;
+
+                    blockedRows(shape, first, std::min(shape.neurons, first + ThreadedBlock), weights, inputs, outputs, activation);
+                });
+
+                break;
+            }
+        }
+    }
+
+    const char *Autotuner::Name(Kernel kernel) noexcept
+    {
+        switch (kernel)
+        {
+            case Kernel::Scalar: return "scalar";
+            case Kernel::Blocked: return "blocked";
+            case Kernel::Threaded: return "threaded";
+        }
+
+        return "unknown";
+    }
+
+
+    // Protected Functions
+
+
+    Autotuner::Kernel Autotuner::Tune(const Shape &shape) const
+    {
+        trace::Span tuneSpan("autotune", "startup", shape.neurons);
+
+        auto candidates = std::vector<Kernel>({ Kernel::Scalar, Kernel::Blocked });
+
+        // Threading only pays for itself if there's more than one block to share out
+        // Asked without starting the executor, which only the threaded kernel needs
+        if (Executor::DefaultThreadCount() > 1 && shape.neurons > ThreadedBlock) candidates.push_back(Kernel::Threaded);
+
+        // Made up weights and inputs, only the time matters
+        auto random = std::mt19937_64(shape.neurons * 31 + shape.inputs);
+        auto distribution = std::uniform_real_distribution<double>(-1.0, 1.0);
+
+        auto weights = std::vector<double>(shape.neurons * shape.stride);
+        auto inputs = std::vector<double>(shape.batch * shape.stride);
+        auto outputs = std::vector<double>(shape.batch * shape.stride);
+
+        for (auto &weight : weights) weight = distribution(random);
+        for (auto &input : inputs) input = distribution(random);
+
+        auto activation = activation_func_type([](const double &x) { return 1.0 / (1.0 + std::exp(-x)); });
+        auto best = std::vector<double>(candidates.size(), std::numeric_limits<double>::infinity());
+
+        // Take turns, so anything slowing the machine down hits every kernel alike
+        for (size_t trial = 0; trial < this->m_Options.trials; trial++)
+        {
+            for (size_t c = 0; c < candidates.size(); c++)
+            {
+                // Warm the caches up first
+                Autotuner::Run(candidates[c], shape, weights.data(), inputs.data(), outputs.data(), activation);
+
+                size_t runs = 0;
+                auto start = std::chrono::steady_clock::now();
+                auto elapsed = std::chrono::steady_clock::duration::zero();
+
+                do
+                {
+                    Autotuner::Run(candidates[c], shape, weights.data(), inputs.data(), outputs.data(), activation);
+
+                    runs++;
+                    elapsed = std::chrono::steady_clock::now() - start;
+                }
+                while (elapsed < this->m_Options.trialTime);
+
+                best[c] = std::min(best[c], std::chrono::duration<double>(elapsed).count() / runs);
+            }
+        }
+
+        return candidates[std::min_element(best.begin(), best.end()) - best.begin()];
+    }
+
+    void Autotuner::Load()
+    {
+        auto file = std::ifstream(this->m_CacheFile);
+        auto line = std::string();
+
+        while (std::getline(file, line))
+        {
+            auto fields = std::istringstream(line);
+            auto host = std::string();
+            auto kernel = std::string();
+            auto shape = Shape();
+
+            if (!std::getline(fields, host, '\t') || host != this->m_Host) continue;
+
+            if (!(fields >> shape.inputs >> shape.stride >> shape.neurons >> shape.batch >> kernel)) continue;
+
+            for (Kernel candidate : { Kernel::Scalar, Kernel::Blocked, Kernel::Threaded })
+            {
+                if (kernel == Autotuner::Name(candidate)) this->m_Choices[shape] = candidate;
+            }
+        }
+    }
+
+    void Autotuner::Save(const std::map<Shape, Kernel> &choices) const
+    {
+        auto scopedLock = std::scoped_lock(this->m_SaveLock);
+
+        auto lines = std::vector<std::string>();
+
+        // Keep what other hosts have cached, the file may be shared between machines
+        {
+            auto file = std::ifstream(this->m_CacheFile);
+            auto line = std::string();
+
+            while (std::getline(file, line))
+            {
+                if (line.substr(0, line.find('\t')) != this->m_Host) lines.push_back(line);
+            }
+        }
+
+        std::error_code error;
+        auto path = std::filesystem::path(this->m_CacheFile);
+
+        if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path(), error);
+
+        // Write a copy then swap it in, so another process never reads half a file
+        auto temporary = this->m_CacheFile + ".tmp." + std::to_string(getpid());
+
+        {
+            auto file = std::ofstream(temporary, std::ios::trunc);
+
+            if (!file) return;
+
+            for (auto &line : lines) file << line << '\n';
+
+            for (auto &[shape, kernel] : choices)
+            {
+                file << this->m_Host << '\t' << shape.inputs << '\t' << shape.stride << '\t' << shape.neurons << '\t' << shape.batch << '\t' << Autotuner::Name(kernel) << '\n';
+            }
+
+            if (!file) return;
+        }
+
+        std::filesystem::rename(temporary, this->m_CacheFile, error);
+
+        if (error) std::filesystem::remove(temporary, error);
+    }
+
+    std::string Autotuner::DefaultCacheFile()
+    {
+        const char *cacheHome = std::getenv("XDG_CACHE_HOME");
+        const char *home = std::getenv("HOME");
+
+        if (cacheHome != nullptr && *cacheHome != '\0') return std::string(cacheHome) + "/ai_assignment/kernels.tsv";
+        if (home != nullptr && *home != '\0') return std::string(home) + "/.cache/ai_assignment/kernels.tsv";
+
+        return "kernels.tsv";
+    }
+
+} // End namespace ai_assignment
@@ -0,0 +1,12 @@
+#pragma once
+#ifndef FWD_H_530093_SRC_AUTOTUNER
+#define FWD_H_530093_SRC_AUTOTUNER 1
+
+namespace ai_assignment
+{
+    class Autotuner;
+
+} // End namespace ai_assignment
+
+
+#endif // FWD_H_530093_SRC_AUTOTUNER
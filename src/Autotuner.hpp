@@ -0,0 +1,202 @@
+#pragma once
+#ifndef H_530093_SRC_AUTOTUNER
+#define H_530093_SRC_AUTOTUNER 1
+
+#include "Autotuner.fwd.hpp"
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+
+namespace ai_assignment
+{
+    /**
+     * @brief Times the layer kernels on each layer shape the first time it's seen and picks the fastest. The choices are kept in a cache file, keyed by the CPU model, so later runs on the same kind of machine skip the timing. Every kernel sums a neuron's inputs in the same order, so the choice never changes the results. Off unless enabled, since timing costs milliseconds per layer. Thread safe
+     */
+    class Autotuner
+    {
+        public:
+
+            // Definitions
+
+            typedef std::function<double(const double&)> activation_func_type;
+
+            enum class Kernel : uint8_t
+            {
+                // One neuron at a time
+                Scalar,
+                // Four neurons at a time, so each input is loaded once for all four
+                Blocked,
+                // Blocks of neurons spread over the default executor
+                Threaded
+            };
+
+            /**
+             * @brief What a kernel is run on: neurons rows of stride weights, each summed over the first inputs values of batch input rows
+             */
+            struct Shape
+            {
+                size_t inputs = 0;
+                size_t stride = 0;
+                size_t neurons = 0;
+                size_t batch = 1;
+
+                auto operator<=>(const Shape &obj) const = default;
+            };
+
+            struct Options
+            {
+                /**
+                 * @brief Time the kernels and use the cache file. Off uses the scalar kernel everywhere, without timing anything, reading the cache file or starting the default executor
+                 */
+                bool enabled = false;
+
+                /**
+                 * @brief Where to keep the choices between runs. Empty uses $XDG_CACHE_HOME/ai_assignment/kernels.tsv (or ~/.cache/...)
+                 */
+                std::string cacheFile = "";
+
+                /**
+                 * @brief How long each kernel is run for in each trial
+                 */
+                std::chrono::microseconds trialTime = std::chrono::microseconds(2000);
+
+                /**
+                 * @brief The number of trials of each kernel, the fastest trial counts
+                 */
+                size_t trials = 3;
+            };
+
+            struct Stats
+            {
+                /**
+                 * @brief Shapes which had to be timed
+                 */
+                size_t tuned = 0;
+
+                /**
+                 * @brief Shapes found in the cache file, or already chosen this run
+                 */
+                size_t cached = 0;
+            };
+
+
+            // Constructors
+
+
+            /**
+             * @brief Construct an Autotuner with the default cache file
+             */
+            inline Autotuner()
+                : Autotuner(Options())
+            {}
+
+            /**
+             * @brief Construct an Autotuner, reading in the choices cached for this machine
+             *
+             * @param options Where the cache file is and how long to spend timing
+             */
+            Autotuner(const Options &options);
+
+            Autotuner(const Autotuner &obj) = delete;
+            Autotuner &operator=(const Autotuner &obj) = delete;
+
+            virtual ~Autotuner() noexcept = default;
+
+            /**
+             * @brief The autotuner shared by every net, created on first use
+             */
+            static Autotuner &Default();
+
+            /**
+             * @brief Set the options the default autotuner is created with. Must be called before any net is constructed
+             */
+            static void SetDefaultOptions(const Options &options);
+
+            // Accessors
+
+            /**
+             * @brief The CPU model and thread count the cached choices are for, since the threaded kernel depends on both. Empty when disabled
+             */
+            inline const std::string &Host() const noexcept
+            {
+                return this->m_Host;
+            }
+
+            Stats GetStats() const;
+
+            // Functions
+
+            /**
+             * @brief The fastest kernel for a shape, timing the kernels if it hasn't been seen on this machine before. New choices are written to the cache file straight away
+             */
+            Kernel Choose(const Shape &shape);
+
+            /**
+             * @brief Runs a kernel, setting outputs[b ⨉ stride + j] to the activation of neuron j's weighted sum of input row b, for every neuron j and row b. The rest of each output row is left as it was
+             *
+             * @param kernel The kernel to run
+             * @param shape The shape of the weights and inputs
+             * @param weights neurons rows of stride weights
+             * @param inputs batch rows of stride values
+             * @param outputs batch rows of stride values
+             * @param activation The activation function of the layer
+             */
+            static void Run(Kernel kernel, const Shape &shape, const double *weights, const double *inputs, double *outputs, const activation_func_type &activation);
+
+            static const char *Name(Kernel kernel) noexcept;
+
+        protected:
+
+            // Properties
+
+            const Options m_Options;
+
+            const std::string m_Host;
+
+            const std::string m_CacheFile;
+
+            std::map<Shape, Kernel> m_Choices;
+
+            Stats m_Stats;
+
+            /**
+             * @brief A mutex to guard m_Choices and m_Stats. Never held while timing, since the threaded kernel's loops may run other work which chooses kernels itself
+             */
+            mutable std::mutex m_Lock;
+
+            /**
+             * @brief A mutex to keep threads of this process from writing the cache file at the same time
+             */
+            mutable std::mutex m_SaveLock;
+
+            // Functions
+
+            /**
+             * @brief Time every kernel on random weights and inputs of a shape
+             */
+            Kernel Tune(const Shape &shape) const;
+
+            /**
+             * @brief Reads the choices for this host from the cache file, if there is one
+             */
+            void Load();
+
+            /**
+             * @brief Writes choices to the cache file, keeping the lines of other hosts. Best effort, since tuning again next time is no great loss
+             */
+            void Save(const std::map<Shape, Kernel> &choices) const;
+
+            static std::string DefaultCacheFile();
+    };
+
+} // End namespace ai_assignment
+
+
+#endif // H_530093_SRC_AUTOTUNER
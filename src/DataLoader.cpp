@@ -0,0 +1,530 @@
+#include "DataLoader.hpp"
+
+#include <cmath>
+#include <string>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <utility>
+#include <charconv>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "utils.hpp"
+
+
+namespace ai_assignment::data_loader
+{
+    namespace
+    {
+        /**
+         * @brief The minimum amount of a file given to each thread, smaller files aren't worth splitting up
+         */
+        constexpr size_t MinimumChunkSize = 64 * 1024;
+
+        /**
+         * @brief The contents of a file, either mapped or read into memory
+         */
+        class FileContents
+        {
+            public:
+
+                FileContents(const std::string &path, bool useMmap)
+                {
+                    if (useMmap)
+                    {
+                        int fd = open(path.c_str(), O_RDONLY);
+
+                        if (fd < 0) throw std::runtime_error("Unable to open " + path);
+
+                        struct stat info;
+
+                        if (fstat(fd, &info) != 0)
+                        {
+                            close(fd);
+                            throw std::runtime_error("Unable to stat " + path);
+                        }
+
+                        this->size = info.st_size;
+
+                        // Mapping nothing is an error, but there's nothing to read anyway
+                        if (this->size > 0)
+                        {
+                            this->m_Mapping = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+                        }
+
+                        close(fd);
+
+                        if (this->m_Mapping == MAP_FAILED) throw std::runtime_error("Unable to map " + path);
+
+                        // We read front to back, so let the kernel read ahead
+                        if (this->m_Mapping != nullptr) madvise(this->m_Mapping, this->size, MADV_SEQUENTIAL);
+
+                        this->data = static_cast<const char*>(this->m_Mapping);
+                    }
+                    else
+                    {
+                        auto file = std::ifstream(path, std::ios::binary);
+
+                        if (!file) throw std::runtime_error("Unable to open " + path);
+
+                        this->m_Buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+                        this->data = this->m_Buffer.data();
+                        this->size = this->m_Buffer.size();
+                    }
+                }
+
+                FileContents(const FileContents &obj) = delete;
+
+                ~FileContents()
+                {
+                    if (this->m_Mapping != nullptr && this->m_Mapping != MAP_FAILED) munmap(this->m_Mapping, this->size);
+                }
+
+                const char *data = nullptr;
+                size_t size = 0;
+
+            private:
+
+                void *m_Mapping = nullptr;
+                std::string m_Buffer;
+        };
+
+        /**
+         * @brief Splits [begin, end) into roughly even chunks which each end just after a newline
+         */
+        std::vector<std::pair<size_t, size_t>> splitChunks(const char *data, size_t begin, size_t end, size_t threads)
+        {
+            size_t chunkCount = std::max<size_t>(1, std::min(threads * 4, (end - begin) / MinimumChunkSize));
+            size_t chunkSize = (end - begin) / chunkCount;
+
+            auto chunks = std::vector<std::pair<size_t, size_t>>();
+
+            while (begin < end)
+            {
+                size_t chunkEnd = std::min(end, begin + chunkSize);
+
+                // Move the end to the start of the next line
+                auto *newline = static_cast<const char*>(std::memchr(data + chunkEnd, '\n', end - chunkEnd));
+                chunkEnd = (newline == nullptr)? end : newline - data + 1;
+
+                chunks.push_back({ begin, chunkEnd });
+                begin = chunkEnd;
+            }
+
+            return chunks;
+        }
+
+        /**
+         * @brief Finds the end of the line starting at begin, excluding any carriage return
+         *
+         * @param next Set to the start of the following line
+         */
+        const char *lineEnd(const char *begin, const char *end, const char *&next)
+        {
+            auto *newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+
+            next = (newline == nullptr)? end : newline + 1;
+
+            const char *last = (newline == nullptr)? end : newline;
+
+            if (last > begin && last[-1] == '\r') last--;
+
+            return last;
+        }
+
+        inline const char *skipSpaces(const char *p, const char *end)
+        {
+            while (p < end && (*p == ' ' || *p == '\t')) p++;
+
+            return p;
+        }
+
+        /**
+         * @brief Parses a number and moves p past it
+         */
+        template<typename T>
+        inline T parseNumber(const char *&p, const char *end, const char *fileStart)
+        {
+            p = skipSpaces(p, end);
+
+            // from_chars doesn't accept an explicit positive sign
+            if (p < end && *p == '+') p++;
+
+            T value;
+            auto result = std::from_chars(p, end, value);
+
+            if (result.ec != std::errc()) throw std::invalid_argument("Malformed number at byte " + std::to_string(p - fileStart));
+
+            p = result.ptr;
+
+            return value;
+        }
+
+        /**
+         * @brief The number of fields on the first non-empty line at or after begin
+         */
+        size_t countFields(const char *begin, const char *end, char delimiter)
+        {
+            const char *next;
+
+            for (; begin < end; begin = next)
+            {
+                const char *last = lineEnd(begin, end, next);
+
+                if (skipSpaces(begin, last) == last) continue;
+
+                return std::count(begin, last, delimiter) + 1;
+            }
+
+            return 0;
+        }
+
+        /**
+         * @brief Joins the examples parsed by each chunk, in order
+         */
+        template<typename T>
+        std::vector<T> concatenate(std::vector<std::vector<T>> &chunks)
+        {
+            size_t total = 0;
+
+            for (auto &chunk : chunks) total += chunk.size();
+
+            auto out = std::vector<T>();
+            out.reserve(total);
+
+            for (auto &chunk : chunks)
+            {
+                std::move(chunk.begin(), chunk.end(), std::back_inserter(out));
+            }
+
+            return out;
+        }
+
+        /**
+         * @brief The sparse contents of a chunk of a libsvm file, in flat buffers which grow without per-row allocations
+         */
+        struct SparseChunk
+        {
+            std::vector<double> labels;
+            // The first entry of each row in indices/values, plus one past the end
+            std::vector<size_t> rowStarts = { 0 };
+            std::vector<size_t> indices;
+            std::vector<double> values;
+            size_t maxIndex = 0;
+        };
+
+        /**
+         * @brief Parse a libsvm file into sparse chunks, in parallel
+         *
+         * @param features Set to the number of features, from the options or the largest index in the file
+         */
+        std::vector<SparseChunk> parseLibSvm(const FileContents &file, const Options &options, size_t threads, size_t &features)
+        {
+            const char *data = file.data;
+            const char *end = data + file.size;
+
+            auto chunks = splitChunks(data, 0, file.size, threads);
+            auto sparse = std::vector<SparseChunk>(chunks.size());
+
+            utils::parallelFor(chunks.size(), [&](size_t c)
+            {
+                auto &chunk = sparse[c];
+                const char *next;
+
+                for (const char *line = data + chunks[c].first; line < data + chunks[c].second; line = next)
+                {
+                    const char *last = lineEnd(line, end, next);
+
+                    // Drop comments
+                    if (last > line)
+                    {
+                        auto *comment = static_cast<const char*>(std::memchr(line, '#', static_cast<size_t>(last - line)));
+                        if (comment != nullptr) last = comment;
+                    }
+
+                    const char *p = skipSpaces(line, last);
+
+                    if (p == last) continue;
+
+                    chunk.labels.push_back(parseNumber<double>(p, last, data));
+
+                    while ((p = skipSpaces(p, last)) < last)
+                    {
+                        // Query ids are for ranking, which we don't do
+                        if (last - p > 4 && std::strncmp(p, "qid:", 4) == 0)
+                        {
+                            while (p < last && *p != ' ' && *p != '\t') p++;
+                            continue;
+                        }
+
+                        size_t index = parseNumber<size_t>(p, last, data);
+
+                        if (p == last || *p != ':') throw std::invalid_argument("Expected index:value at byte " + std::to_string(p - data));
+                        p++;
+
+                        if (options.oneBasedIndices)
+                        {
+                            if (index == 0) throw std::out_of_range("Feature index 0 in a file with one based indices at byte " + std::to_string(p - data));
+
+                            index--;
+                        }
+
+                        chunk.indices.push_back(index);
+                        chunk.values.push_back(parseNumber<double>(p, last, data));
+                        chunk.maxIndex = std::max(chunk.maxIndex, index + 1);
+                    }
+
+                    chunk.rowStarts.push_back(chunk.indices.size());
+                }
+            }, threads);
+
+            features = options.features;
+
+            if (features == 0)
+            {
+                for (auto &chunk : sparse) features = std::max(features, chunk.maxIndex);
+            }
+
+            for (auto &chunk : sparse)
+            {
+                if (chunk.maxIndex > features) throw std::out_of_range("Feature index " + std::to_string(chunk.maxIndex) + " is past the number of features");
+            }
+
+            return sparse;
+        }
+
+        /**
+         * @brief The number of rows in the chunks before each chunk, so rows can be numbered across the file
+         */
+        std::vector<size_t> firstRows(const std::vector<SparseChunk> &sparse)
+        {
+            auto first = std::vector<size_t>(sparse.size());
+            size_t rows = 0;
+
+            for (size_t c = 0; c < sparse.size(); c++)
+            {
+                first[c] = rows;
+                rows += sparse[c].labels.size();
+            }
+
+            return first;
+        }
+
+        /**
+         * @brief Turn a label into target outputs, either as is or one-hot
+         *
+         * @param row The row of the file the label is from, counting from one, for errors
+         */
+        std::vector<double> encodeLabel(double label, size_t row, const Options &options)
+        {
+            if (options.classes == 0) return { label };
+
+            // Compared as doubles first, since casting one out of range is undefined
+            if (!(label >= 0.0 && label < static_cast<double>(options.classes)) || label != std::floor(label))
+            {
+                throw std::invalid_argument("Label " + std::to_string(label) + " of row " + std::to_string(row) + " isn't a class in [0, " + std::to_string(options.classes) + ")");
+            }
+
+            auto targetOutput = std::vector<double>(options.classes);
+            targetOutput[static_cast<size_t>(label)] = 1.0;
+
+            return targetOutput;
+        }
+
+    } // End anonymous namespace
+
+
+    std::vector<Example> LoadCsv(const std::string &path, const Options &options)
+    {
+        auto file = FileContents(path, options.useMmap);
+        const char *data = file.data;
+        const char *end = data + file.size;
+
+        // Skip the header
+        const char *begin = data;
+
+        if (options.hasHeader) lineEnd(data, end, begin);
+
+        // Work out which columns go where from the first row
+        size_t fieldCount = countFields(begin, end, options.delimiter);
+
+        if (fieldCount == 0) return std::vector<Example>();
+
+        auto targetColumns = options.targetColumns;
+        auto inputColumns = options.inputColumns;
+
+        if (targetColumns.empty()) targetColumns.push_back(fieldCount - 1);
+
+        if (inputColumns.empty())
+        {
+            for (size_t i = 0; i < fieldCount; i++)
+            {
+                if (std::find(targetColumns.begin(), targetColumns.end(), i) == targetColumns.end()) inputColumns.push_back(i);
+            }
+        }
+
+        for (auto column : inputColumns) if (column >= fieldCount) throw std::out_of_range("Input column " + std::to_string(column) + " is past the end of the row");
+        for (auto column : targetColumns) if (column >= fieldCount) throw std::out_of_range("Target column " + std::to_string(column) + " is past the end of the row");
+
+        size_t threads = utils::threadCount(options.threads);
+        auto chunks = splitChunks(data, begin - data, file.size, threads);
+        auto parsed = std::vector<std::vector<Example>>(chunks.size());
+
+        utils::parallelFor(chunks.size(), [&](size_t c)
+        {
+            auto &examples = parsed[c];
+            // Reused for every row of the chunk
+            auto fields = std::vector<double>(fieldCount);
+
+            const char *next;
+
+            for (const char *line = data + chunks[c].first; line < data + chunks[c].second; line = next)
+            {
+                const char *last = lineEnd(line, end, next);
+
+                if (skipSpaces(line, last) == last) continue;
+
+                // Parse every field of the row
+                const char *p = line;
+                size_t field = 0;
+
+                while (true)
+                {
+                    if (field == fieldCount) throw std::invalid_argument("Row at byte " + std::to_string(line - data) + " has more than " + std::to_string(fieldCount) + " fields");
+
+                    fields[field++] = parseNumber<double>(p, last, data);
+                    p = skipSpaces(p, last);
+
+                    if (p == last) break;
+                    if (*p != options.delimiter) throw std::invalid_argument("Unexpected character at byte " + std::to_string(p - data));
+
+                    p++;
+                }
+
+                if (field != fieldCount) throw std::invalid_argument("Row at byte " + std::to_string(line - data) + " has " + std::to_string(field) + " fields, expected " + std::to_string(fieldCount));
+
+                // Pick out the columns
+                auto &example = examples.emplace_back();
+                example.inputs.resize(inputColumns.size() + options.appendBias);
+                example.targetOutput.resize(targetColumns.size());
+
+                for (size_t i = 0; i < inputColumns.size(); i++) example.inputs[i] = fields[inputColumns[i]];
+                for (size_t i = 0; i < targetColumns.size(); i++) example.targetOutput[i] = fields[targetColumns[i]];
+
+                if (options.appendBias) example.inputs.back() = 1.0;
+            }
+        }, threads);
+
+        return concatenate(parsed);
+    }
+
+    std::vector<Example> LoadLibSvm(const std::string &path, const Options &options)
+    {
+        auto file = FileContents(path, options.useMmap);
+
+        size_t threads = utils::threadCount(options.threads);
+        size_t features;
+
+        // Parse into flat sparse buffers first, since we may not know the number of features until the whole file is read
+        auto sparse = parseLibSvm(file, options, threads, features);
+
+        // Then scatter each chunk into dense examples
+        auto parsed = std::vector<std::vector<Example>>(sparse.size());
+        auto first = firstRows(sparse);
+
+        utils::parallelFor(sparse.size(), [&](size_t c)
+        {
+            auto &chunk = sparse[c];
+            auto &examples = parsed[c];
+
+            examples.resize(chunk.labels.size());
+
+            for (size_t row = 0; row < chunk.labels.size(); row++)
+            {
+                auto &example = examples[row];
+                example.inputs.resize(features + options.appendBias);
+
+                for (size_t i = chunk.rowStarts[row]; i < chunk.rowStarts[row + 1]; i++)
+                {
+                    example.inputs[chunk.indices[i]] = chunk.values[i];
+                }
+
+                if (options.appendBias) example.inputs.back() = 1.0;
+
+                example.targetOutput = encodeLabel(chunk.labels[row], first[c] + row + 1, options);
+            }
+
+            // We're done with the sparse buffers of this chunk
+            chunk = SparseChunk();
+        }, threads);
+
+        return concatenate(parsed);
+    }
+
+    std::vector<SparseExample> LoadLibSvmSparse(const std::string &path, const Options &options)
+    {
+        auto file = FileContents(path, options.useMmap);
+
+        size_t threads = utils::threadCount(options.threads);
+        size_t features;
+
+        auto sparse = parseLibSvm(file, options, threads, features);
+        auto parsed = std::vector<std::vector<SparseExample>>(sparse.size());
+        auto first = firstRows(sparse);
+
+        utils::parallelFor(sparse.size(), [&](size_t c)
+        {
+            auto &chunk = sparse[c];
+            auto &examples = parsed[c];
+
+            examples.resize(chunk.labels.size());
+
+            // Reused for rows which need sorting
+            auto order = std::vector<size_t>();
+
+            for (size_t row = 0; row < chunk.labels.size(); row++)
+            {
+                auto &inputs = examples[row].inputs;
+                inputs.dimension = features + options.appendBias;
+
+                size_t begin = chunk.rowStarts[row];
+                size_t end = chunk.rowStarts[row + 1];
+
+                inputs.indices.reserve(end - begin + options.appendBias);
+                inputs.values.reserve(end - begin + options.appendBias);
+
+                // Files should list indices in ascending order, but not every writer does
+                order.resize(end - begin);
+                std::iota(order.begin(), order.end(), begin);
+                std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return chunk.indices[a] < chunk.indices[b]; });
+
+                for (size_t i : order)
+                {
+                    // A repeated index keeps its last value, as it does when loading densely
+                    if (!inputs.indices.empty() && inputs.indices.back() == chunk.indices[i])
+                    {
+                        inputs.values.back() = chunk.values[i];
+                        continue;
+                    }
+
+                    inputs.indices.push_back(chunk.indices[i]);
+                    inputs.values.push_back(chunk.values[i]);
+                }
+
+                if (options.appendBias) inputs.Push(features, 1.0);
+
+                examples[row].targetOutput = encodeLabel(chunk.labels[row], first[c] + row + 1, options);
+            }
+
+            chunk = SparseChunk();
+        }, threads);
+
+        return concatenate(parsed);
+    }
+
+} // End namespace ai_assignment::data_loader
@@ -0,0 +1,106 @@
+#pragma once
+#ifndef H_530093_SRC_DATA_LOADER
+#define H_530093_SRC_DATA_LOADER 1
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "SparseVector.hpp"
+#include "TrainingExample.hpp"
+
+
+/**
+ * @brief Parallel loaders which turn dense CSV and sparse libsvm files into training examples
+ */
+namespace ai_assignment::data_loader
+{
+    typedef TrainingExample<std::vector<double>> Example;
+    typedef TrainingExample<std::vector<double>, SparseVector> SparseExample;
+
+    struct Options
+    {
+        /**
+         * @brief The number of threads to parse with, zero uses one per core
+         */
+        size_t threads = 0;
+
+        /**
+         * @brief Read the file through mmap instead of copying it into memory
+         */
+        bool useMmap = true;
+
+        /**
+         * @brief Append a 1.0 to the inputs of every example, the bias/threshold the net expects as its last input
+         */
+        bool appendBias = true;
+
+        // CSV
+
+        char delimiter = ',';
+
+        /**
+         * @brief Skip the first line of the file
+         */
+        bool hasHeader = false;
+
+        /**
+         * @brief The columns to use as inputs, in order. Empty uses every column which isn't a target
+         */
+        std::vector<size_t> inputColumns = {};
+
+        /**
+         * @brief The columns to use as target outputs, in order. Empty uses the last column
+         */
+        std::vector<size_t> targetColumns = {};
+
+        // libsvm
+
+        /**
+         * @brief The number of features, excluding the bias. Zero uses the largest index in the file
+         */
+        size_t features = 0;
+
+        /**
+         * @brief Zero makes the label the only target output. Otherwise the label is a class index, an integer in [0, classes), and the target output is one-hot with this many classes
+         */
+        size_t classes = 0;
+
+        /**
+         * @brief Feature indices start at 1 (the libsvm convention) instead of 0
+         */
+        bool oneBasedIndices = true;
+    };
+
+
+    /**
+     * @brief Load a dense CSV file, one example per line. Empty lines are skipped
+     *
+     * @param path The file to load
+     * @param options How to parse the file and pick out the inputs and targets
+     * @return std::vector<Example> The examples, in file order
+     */
+    std::vector<Example> LoadCsv(const std::string &path, const Options &options = Options());
+
+    /**
+     * @brief Load a sparse libsvm file ("label index:value index:value ...", '#' starts a comment) into dense examples
+     *
+     * @param path The file to load
+     * @param options How to size the inputs and encode the label
+     * @return std::vector<Example> The examples, in file order
+     */
+    std::vector<Example> LoadLibSvm(const std::string &path, const Options &options = Options());
+
+    /**
+     * @brief Load a sparse libsvm file into sparse examples, for nets trained with NeuralNet::TrainEpoch on sparse examples. Indices are sorted if the file doesn't list them in order
+     *
+     * @param path The file to load
+     * @param options How to size the inputs and encode the label
+     * @return std::vector<SparseExample> The examples, in file order
+     */
+    std::vector<SparseExample> LoadLibSvmSparse(const std::string &path, const Options &options = Options());
+
+} // End namespace ai_assignment::data_loader
+
+
+#endif // H_530093_SRC_DATA_LOADER
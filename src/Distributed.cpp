@@ -0,0 +1,685 @@
+#include "Distributed.hpp"
+
+#include <poll.h>
+#include <cmath>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+
+namespace ai_assignment::distributed
+{
+    namespace
+    {
+        // Definitions
+
+        typedef std::chrono::steady_clock steady_clock;
+
+        enum class MessageType : uint32_t
+        {
+            // Worker → coordinator, the size of its shard
+            Hello,
+            // Coordinator → worker, the full weights
+            Weights,
+            // Worker → coordinator, an encoded weight delta
+            Update
+        };
+
+        /**
+         * @brief Every message is a header followed by payloadBytes of payload. Only used between processes on one machine, so no byte swapping
+         */
+        struct MessageHeader
+        {
+            MessageType type = MessageType::Hello;
+            Compression compression = Compression::None;
+            // The version of the weights sent, or the version an update is based on
+            uint64_t version = 0;
+            uint64_t examples = 0;
+            double mse = 0.0;
+            double computeSeconds = 0.0;
+            uint64_t payloadBytes = 0;
+        };
+
+        /**
+         * @brief The number of values sharing one scale in Int8 encoding
+         */
+        constexpr size_t Int8BlockSize = 256;
+
+
+        // Sockets
+
+        /**
+         * @brief Waits for a socket to be ready, throwing on timeout
+         */
+        void waitFor(int fd, short events, std::chrono::milliseconds timeout)
+        {
+            auto descriptor = pollfd{ .fd = fd, .events = events, .revents = 0 };
+
+            int ready;
+
+            do ready = poll(&descriptor, 1, timeout.count());
+            while (ready < 0 && errno == EINTR);
+
+            if (ready < 0) throw std::runtime_error(std::string("poll failed: ") + std::strerror(errno));
+            if (ready == 0) throw std::runtime_error("Timed out waiting on a connection");
+        }
+
+        void sendAll(int fd, const void *data, size_t size, std::chrono::milliseconds timeout)
+        {
+            auto *next = static_cast<const char*>(data);
+
+            while (size > 0)
+            {
+                waitFor(fd, POLLOUT, timeout);
+
+                ssize_t sent = send(fd, next, size, MSG_NOSIGNAL);
+
+                if (sent < 0 && errno == EINTR) continue;
+                if (sent <= 0) throw std::runtime_error(std::string("send failed: ") + std::strerror(errno));
+
+                next += sent;
+                size -= sent;
+            }
+        }
+
+        void receiveAll(int fd, void *data, size_t size, std::chrono::milliseconds timeout)
+        {
+            auto *next = static_cast<char*>(data);
+
+            while (size > 0)
+            {
+                waitFor(fd, POLLIN, timeout);
+
+                ssize_t received = recv(fd, next, size, 0);
+
+                if (received < 0 && errno == EINTR) continue;
+                if (received == 0) throw std::runtime_error("Connection closed");
+                if (received < 0) throw std::runtime_error(std::string("recv failed: ") + std::strerror(errno));
+
+                next += received;
+                size -= received;
+            }
+        }
+
+        /**
+         * @brief Sends a header and its payload, returning the bytes sent
+         */
+        size_t sendMessage(int fd, MessageHeader header, const vector<char> &payload, std::chrono::milliseconds timeout)
+        {
+            header.payloadBytes = payload.size();
+
+            sendAll(fd, &header, sizeof(header), timeout);
+            sendAll(fd, payload.data(), payload.size(), timeout);
+
+            return sizeof(header) + payload.size();
+        }
+
+        /**
+         * @brief Receives a header and its payload, returning the bytes received
+         */
+        size_t receiveMessage(int fd, MessageHeader &header, vector<char> &payload, std::chrono::milliseconds timeout)
+        {
+            receiveAll(fd, &header, sizeof(header), timeout);
+
+            payload.resize(header.payloadBytes);
+            receiveAll(fd, payload.data(), payload.size(), timeout);
+
+            return sizeof(header) + payload.size();
+        }
+
+        /**
+         * @brief Keeps small messages from sitting in Nagle's buffer
+         */
+        void setNoDelay(int fd)
+        {
+            int on = 1;
+
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+
+
+        // Encoding
+
+        /**
+         * @brief Encode values, keeping in residual whatever the encoding lost so the next call can send it
+         *
+         * @param values The values to send, has the residual of the last call added to it first
+         * @param residual The rounding error carried over between calls
+         */
+        vector<char> encode(vector<double> &values, vector<double> &residual, Compression compression)
+        {
+            auto payload = vector<char>();
+
+            for (size_t i = 0; i < values.size(); i++) values[i] += residual[i];
+
+            switch (compression)
+            {
+                case Compression::None:
+                {
+                    payload.resize(values.size() * sizeof(double));
+                    std::memcpy(payload.data(), values.data(), payload.size());
+
+                    std::fill(residual.begin(), residual.end(), 0.0);
+                    break;
+                }
+
+                case Compression::Float32:
+                {
+                    payload.resize(values.size() * sizeof(float));
+                    auto *out = reinterpret_cast<float*>(payload.data());
+
+                    for (size_t i = 0; i < values.size(); i++)
+                    {
+                        out[i] = static_cast<float>(values[i]);
+                        residual[i] = values[i] - out[i];
+                    }
+
+                    break;
+                }
+
+                case Compression::Int8:
+                {
+                    size_t blocks = (values.size() + Int8BlockSize - 1) / Int8BlockSize;
+                    payload.resize(blocks * sizeof(float) + values.size());
+
+                    auto *scales = reinterpret_cast<float*>(payload.data());
+                    auto *out = reinterpret_cast<int8_t*>(payload.data() + blocks * sizeof(float));
+
+                    for (size_t b = 0; b < blocks; b++)
+                    {
+                        size_t begin = b * Int8BlockSize;
+                        size_t end = std::min(values.size(), begin + Int8BlockSize);
+
+                        // Scale the block so its largest value maps to ±127
+                        double largest = 0.0;
+
+                        for (size_t i = begin; i < end; i++) largest = std::max(largest, std::abs(values[i]));
+
+                        float scale = static_cast<float>(largest / 127.0);
+                        scales[b] = scale;
+
+                        for (size_t i = begin; i < end; i++)
+                        {
+                            out[i] = (scale == 0.0f)? 0 : static_cast<int8_t>(std::lround(values[i] / scale));
+                            residual[i] = values[i] - out[i] * static_cast<double>(scale);
+                        }
+                    }
+
+                    break;
+                }
+            }
+
+            return payload;
+        }
+
+        /**
+         * @brief Decode a payload from encode into values, which must already be the right size
+         */
+        void decode(const vector<char> &payload, Compression compression, vector<double> &values)
+        {
+            switch (compression)
+            {
+                case Compression::None:
+                {
+                    if (payload.size() != values.size() * sizeof(double)) throw std::runtime_error("Payload doesn't match the number of parameters");
+
+                    std::memcpy(values.data(), payload.data(), payload.size());
+                    break;
+                }
+
+                case Compression::Float32:
+                {
+                    if (payload.size() != values.size() * sizeof(float)) throw std::runtime_error("Payload doesn't match the number of parameters");
+
+                    auto *in = reinterpret_cast<const float*>(payload.data());
+
+                    for (size_t i = 0; i < values.size(); i++) values[i] = in[i];
+
+                    break;
+                }
+
+                case Compression::Int8:
+                {
+                    size_t blocks = (values.size() + Int8BlockSize - 1) / Int8BlockSize;
+
+                    if (payload.size() != blocks * sizeof(float) + values.size()) throw std::runtime_error("Payload doesn't match the number of parameters");
+
+                    auto *scales = reinterpret_cast<const float*>(payload.data());
+                    auto *in = reinterpret_cast<const int8_t*>(payload.data() + blocks * sizeof(float));
+
+                    for (size_t i = 0; i < values.size(); i++) values[i] = in[i] * static_cast<double>(scales[i / Int8BlockSize]);
+
+                    break;
+                }
+            }
+        }
+
+        vector<char> rawPayload(const vector<double> &values)
+        {
+            auto payload = vector<char>(values.size() * sizeof(double));
+
+            std::memcpy(payload.data(), values.data(), payload.size());
+
+            return payload;
+        }
+
+        double secondsSince(steady_clock::time_point start)
+        {
+            return std::chrono::duration<double>(steady_clock::now() - start).count();
+        }
+
+    } // End anonymous namespace
+
+
+    // Coordinator
+
+
+    Coordinator::Coordinator(NeuralNet &net, size_t workers, const Options &options)
+        : m_Net(net),
+            m_Workers(workers),
+            m_Options(options)
+    {
+        if (workers == 0) throw std::invalid_argument("Need at least one worker");
+
+        this->m_Listener = socket(AF_INET, SOCK_STREAM, 0);
+
+        if (this->m_Listener < 0) throw std::runtime_error(std::string("socket failed: ") + std::strerror(errno));
+
+        int on = 1;
+        setsockopt(this->m_Listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        // Only listen on loopback, there's no authentication
+        auto address = sockaddr_in();
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(options.port);
+
+        if (bind(this->m_Listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(this->m_Listener, workers) != 0)
+        {
+            close(this->m_Listener);
+            throw std::runtime_error(std::string("Unable to listen: ") + std::strerror(errno));
+        }
+
+        // Find out which port we were given
+        socklen_t length = sizeof(address);
+        getsockname(this->m_Listener, reinterpret_cast<sockaddr*>(&address), &length);
+
+        this->m_Port = ntohs(address.sin_port);
+    }
+
+    Coordinator::~Coordinator() noexcept
+    {
+        close(this->m_Listener);
+    }
+
+    Report Coordinator::Run()
+    {
+        auto report = Report();
+        report.workers = this->m_Workers;
+
+        auto timeout = this->m_Options.ioTimeout;
+        auto sockets = vector<int>();
+
+        // Close every connection however we leave
+        struct SocketCloser
+        {
+            vector<int> &sockets;
+
+            ~SocketCloser()
+            {
+                for (int fd : sockets) close(fd);
+            }
+        } closer{ sockets };
+
+        auto header = MessageHeader();
+        auto payload = vector<char>();
+        auto shardSizes = vector<uint64_t>();
+
+        // Wait for every worker to say hello
+        while (sockets.size() < this->m_Workers)
+        {
+            waitFor(this->m_Listener, POLLIN, timeout);
+
+            int fd = accept(this->m_Listener, nullptr, nullptr);
+
+            if (fd < 0) throw std::runtime_error(std::string("accept failed: ") + std::strerror(errno));
+
+            sockets.push_back(fd);
+            setNoDelay(fd);
+
+            report.bytesReceived += receiveMessage(fd, header, payload, timeout);
+
+            if (header.type != MessageType::Hello) throw std::runtime_error("Expected a hello from the worker");
+
+            shardSizes.push_back(header.examples);
+        }
+
+        // Everyone starts from our weights
+        auto global = this->m_Net.GetParameters();
+        uint64_t version = 0;
+
+        auto start = steady_clock::now();
+
+        for (int fd : sockets)
+        {
+            report.bytesSent += sendMessage(fd, { .type = MessageType::Weights, .version = version }, rawPayload(global), timeout);
+        }
+
+        // The update each worker has waiting to be averaged, if any
+        struct Pending
+        {
+            bool waiting = false;
+            vector<double> delta;
+            MessageHeader header;
+        };
+
+        auto pending = vector<Pending>(this->m_Workers);
+        auto updatesReceived = vector<size_t>(this->m_Workers);
+        size_t waiting = 0;
+        auto firstWaiting = steady_clock::time_point();
+        auto lastActivity = steady_clock::now();
+
+        for (auto &update : pending) update.delta.resize(global.size());
+
+        while (true)
+        {
+            // Workers which haven't sent every round will send another update
+            size_t outstanding = 0;
+
+            for (size_t w = 0; w < this->m_Workers; w++)
+            {
+                if (updatesReceived[w] < this->m_Options.rounds && !pending[w].waiting) outstanding++;
+            }
+
+            if (outstanding == 0 && waiting == 0) break;
+
+            // Average once everyone is in, or we've given up on the stragglers
+            bool stepReady = waiting > 0 && (outstanding == 0 || steady_clock::now() - firstWaiting >= this->m_Options.stragglerTimeout);
+
+            if (stepReady)
+            {
+                double totalWeight = 0.0;
+                double mse = 0.0;
+                auto step = vector<double>(global.size());
+
+                for (auto &update : pending)
+                {
+                    if (!update.waiting) continue;
+
+                    // Updates based on old weights count for less
+                    uint64_t staleness = version - update.header.version;
+                    double weight = update.header.examples / (1.0 + staleness);
+
+                    if (staleness > 0) report.staleUpdates++;
+
+                    for (size_t i = 0; i < step.size(); i++) step[i] += weight * update.delta[i];
+
+                    totalWeight += weight;
+                    mse += weight * update.header.mse;
+                }
+
+                for (size_t i = 0; i < global.size(); i++) global[i] += step[i] / totalWeight;
+
+                version++;
+                report.steps++;
+                report.mse = mse / totalWeight;
+
+                // Send the new weights to the workers we averaged
+                auto weightsPayload = rawPayload(global);
+
+                for (size_t w = 0; w < this->m_Workers; w++)
+                {
+                    if (!pending[w].waiting) continue;
+
+                    report.bytesSent += sendMessage(sockets[w], { .type = MessageType::Weights, .version = version }, weightsPayload, timeout);
+
+                    pending[w].waiting = false;
+                }
+
+                waiting = 0;
+                continue;
+            }
+
+            // Otherwise wait for more updates
+            auto descriptors = vector<pollfd>();
+
+            for (size_t w = 0; w < this->m_Workers; w++)
+            {
+                // Workers with an update waiting, or which have sent every round, have nothing to send. Negative descriptors are skipped
+                bool expected = updatesReceived[w] < this->m_Options.rounds && !pending[w].waiting;
+
+                descriptors.push_back({ .fd = expected? sockets[w] : -1, .events = POLLIN, .revents = 0 });
+            }
+
+            auto wait = (waiting > 0)?
+                std::chrono::duration_cast<std::chrono::milliseconds>(firstWaiting + this->m_Options.stragglerTimeout - steady_clock::now())
+                :
+                timeout;
+
+            int ready = poll(descriptors.data(), descriptors.size(), std::max<long>(0, wait.count()));
+
+            if (ready < 0 && errno != EINTR) throw std::runtime_error(std::string("poll failed: ") + std::strerror(errno));
+
+            if (ready <= 0)
+            {
+                if (waiting == 0 && steady_clock::now() - lastActivity >= timeout) throw std::runtime_error("Timed out waiting for workers");
+
+                continue;
+            }
+
+            lastActivity = steady_clock::now();
+
+            for (size_t w = 0; w < this->m_Workers; w++)
+            {
+                if ((descriptors[w].revents & (POLLIN | POLLHUP | POLLERR)) == 0) continue;
+
+                auto &update = pending[w];
+
+                report.bytesReceived += receiveMessage(sockets[w], update.header, payload, timeout);
+
+                if (update.header.type != MessageType::Update) throw std::runtime_error("Expected an update from the worker");
+
+                decode(payload, update.header.compression, update.delta);
+
+                update.waiting = true;
+                updatesReceived[w]++;
+                report.updates++;
+                report.computeSeconds += update.header.computeSeconds;
+                report.examplesPerSecond += update.header.examples;
+
+                if (waiting++ == 0) firstWaiting = steady_clock::now();
+            }
+        }
+
+        report.wallSeconds = secondsSince(start);
+        report.examplesPerSecond /= report.wallSeconds;
+        report.efficiency = report.computeSeconds / (this->m_Workers * report.wallSeconds);
+
+        this->m_Net.SetParameters(global);
+
+        return report;
+    }
+
+
+    // Workers
+
+
+    void RunWorker(NeuralNet &net, vector<Example> &shard, uint16_t port, const Options &options)
+    {
+        auto timeout = options.ioTimeout;
+
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+        if (fd < 0) throw std::runtime_error(std::string("socket failed: ") + std::strerror(errno));
+
+        struct SocketCloser
+        {
+            int fd;
+
+            ~SocketCloser()
+            {
+                close(fd);
+            }
+        } closer{ fd };
+
+        auto address = sockaddr_in();
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) throw std::runtime_error(std::string("Unable to connect: ") + std::strerror(errno));
+
+        setNoDelay(fd);
+
+        auto header = MessageHeader();
+        auto payload = vector<char>();
+
+        sendMessage(fd, { .type = MessageType::Hello, .examples = shard.size() }, payload, timeout);
+
+        // Start from the coordinator's weights
+        auto global = vector<double>(net.ParameterCount());
+
+        receiveMessage(fd, header, payload, timeout);
+        decode(payload, Compression::None, global);
+        net.SetParameters(global);
+
+        auto residual = vector<double>(global.size());
+
+        for (size_t round = 0; round < options.rounds; round++)
+        {
+            auto start = steady_clock::now();
+            double mse = 0.0;
+
+            for (size_t epoch = 0; epoch < options.syncInterval; epoch++)
+            {
+                mse = net.TrainEpoch(shard, options.learningRate);
+            }
+
+            double computeSeconds = secondsSince(start);
+
+            // Send how far we've moved from the weights we were given
+            auto delta = net.GetParameters();
+
+            for (size_t i = 0; i < delta.size(); i++) delta[i] -= global[i];
+
+            auto update = MessageHeader{
+                .type = MessageType::Update,
+                .compression = options.compression,
+                .version = header.version,
+                .examples = shard.size() * options.syncInterval,
+                .mse = mse,
+                .computeSeconds = computeSeconds
+            };
+
+            sendMessage(fd, update, encode(delta, residual, options.compression), timeout);
+
+            // Then carry on from the average
+            receiveMessage(fd, header, payload, timeout);
+
+            if (header.type != MessageType::Weights) throw std::runtime_error("Expected weights from the coordinator");
+
+            decode(payload, Compression::None, global);
+            net.SetParameters(global);
+        }
+    }
+
+    Report TrainLocal(NeuralNet &net, const vector<Example> &examples, size_t workers, const Options &options)
+    {
+        auto coordinator = Coordinator(net, workers, options);
+        auto children = vector<pid_t>();
+
+        for (size_t w = 0; w < workers; w++)
+        {
+            pid_t pid = fork();
+
+            if (pid < 0)
+            {
+                for (pid_t child : children) kill(child, SIGTERM);
+
+                throw std::runtime_error(std::string("fork failed: ") + std::strerror(errno));
+            }
+
+            if (pid == 0)
+            {
+                // Child: train on our contiguous slice of the examples, then leave without running the parent's destructors
+                int status = 0;
+
+                try
+                {
+                    auto shard = vector<Example>(
+                        examples.begin() + examples.size() * w / workers,
+                        examples.begin() + examples.size() * (w + 1) / workers
+                    );
+
+                    RunWorker(net, shard, coordinator.Port(), options);
+                }
+                catch (std::exception &e)
+                {
+                    std::cerr << "Worker " << w << ": " << e.what() << std::endl;
+                    status = 1;
+                }
+                catch (...)
+                {
+                    // Nothing may unwind past here, into the parent's copy of the stack
+                    std::cerr << "Worker " << w << ": unknown exception" << std::endl;
+                    status = 1;
+                }
+
+                _exit(status);
+            }
+
+            children.push_back(pid);
+        }
+
+        auto report = Report();
+
+        try
+        {
+            report = coordinator.Run();
+        }
+        catch (...)
+        {
+            for (pid_t child : children) kill(child, SIGTERM);
+            for (pid_t child : children) waitpid(child, nullptr, 0);
+
+            throw;
+        }
+
+        for (pid_t child : children) waitpid(child, nullptr, 0);
+
+        return report;
+    }
+
+    vector<ScalingPoint> MeasureScaling(const NeuralNet &net, const vector<Example> &examples, const vector<size_t> &workerCounts, const Options &options)
+    {
+        auto points = vector<ScalingPoint>();
+
+        for (size_t workers : workerCounts)
+        {
+            // A copy shares the weights, so every run starts from the same place without copying them up front
+            auto copy = NeuralNet(net);
+            auto report = TrainLocal(copy, examples, workers, options);
+
+            double speedup = points.empty()? 1.0 : report.examplesPerSecond / points.front().examplesPerSecond;
+            double baseWorkers = points.empty()? workers : points.front().workers;
+
+            points.push_back({
+                .workers = workers,
+                .examplesPerSecond = report.examplesPerSecond,
+                .speedup = speedup,
+                .efficiency = speedup / (workers / baseWorkers)
+            });
+        }
+
+        return points;
+    }
+
+} // End namespace ai_assignment::distributed
@@ -0,0 +1,215 @@
+#pragma once
+#ifndef H_530093_SRC_DISTRIBUTED
+#define H_530093_SRC_DISTRIBUTED 1
+
+#include "NeuralNet.fwd.hpp"
+
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "NeuralNet.hpp"
+
+
+/**
+ * @brief Data parallel training across processes. Workers train on their own shard and send their weight deltas to a coordinator over TCP, which averages them and sends back the new weights
+ */
+namespace ai_assignment::distributed
+{
+    typedef NeuralNet::Example Example;
+
+    /**
+     * @brief How workers encode their weight deltas
+     */
+    enum class Compression : uint32_t
+    {
+        // Full doubles
+        None,
+        // Halves the traffic
+        Float32,
+        // A quarter of Float32, with one scale per block of 256 values. Workers carry the rounding error over into their next delta
+        Int8
+    };
+
+    struct Options
+    {
+        double learningRate = 0.1;
+
+        /**
+         * @brief The number of updates each worker sends
+         */
+        size_t rounds = 20;
+
+        /**
+         * @brief The number of epochs each worker trains on its shard between updates
+         */
+        size_t syncInterval = 1;
+
+        Compression compression = Compression::Float32;
+
+        /**
+         * @brief How long the coordinator waits for the rest of the workers once the first update of a step arrives. Late updates are folded into the next step, weighted down by how stale they are
+         */
+        std::chrono::milliseconds stragglerTimeout = std::chrono::milliseconds(250);
+
+        /**
+         * @brief How long to wait on a connection before giving up on it
+         */
+        std::chrono::milliseconds ioTimeout = std::chrono::milliseconds(60000);
+
+        /**
+         * @brief The loopback port the coordinator listens on, zero picks a free one
+         */
+        uint16_t port = 0;
+    };
+
+    struct Report
+    {
+        size_t workers = 0;
+
+        /**
+         * @brief The number of times the coordinator averaged updates
+         */
+        size_t steps = 0;
+
+        size_t updates = 0;
+
+        /**
+         * @brief Updates which arrived after the weights they were based on had moved on
+         */
+        size_t staleUpdates = 0;
+
+        double wallSeconds = 0.0;
+
+        /**
+         * @brief The time spent training, summed over every worker
+         */
+        double computeSeconds = 0.0;
+
+        /**
+         * @brief The fraction of the workers' time spent training rather than waiting or communicating: computeSeconds / (workers ⨉ wallSeconds)
+         */
+        double efficiency = 0.0;
+
+        double examplesPerSecond = 0.0;
+
+        /**
+         * @brief The mean squared error of the last epoch of each worker in the last step, weighted by shard size
+         */
+        double mse = 0.0;
+
+        size_t bytesSent = 0;
+        size_t bytesReceived = 0;
+    };
+
+    struct ScalingPoint
+    {
+        size_t workers;
+        double examplesPerSecond;
+
+        /**
+         * @brief Throughput relative to the first worker count measured
+         */
+        double speedup;
+
+        /**
+         * @brief Speedup divided by the growth in workers, 1.0 is perfect scaling
+         */
+        double efficiency;
+    };
+
+
+    /**
+     * @brief Accepts workers and averages their updates. Not thread safe
+     */
+    class Coordinator
+    {
+        public:
+
+            // Constructors
+
+
+            /**
+             * @brief Start listening on the loopback interface
+             *
+             * @param net The net whose weights the workers start from, and which receives the trained weights
+             * @param workers The number of workers to wait for
+             * @param options How to train, must match the workers' options
+             */
+            Coordinator(NeuralNet &net, size_t workers, const Options &options);
+
+            Coordinator(const Coordinator &obj) = delete;
+            Coordinator &operator=(const Coordinator &obj) = delete;
+
+            virtual ~Coordinator() noexcept;
+
+            // Accessors
+
+            /**
+             * @brief The port the workers should connect to
+             */
+            inline uint16_t Port() const noexcept
+            {
+                return this->m_Port;
+            }
+
+            // Functions
+
+            /**
+             * @brief Wait for every worker, then average their updates until they have all sent every round. Sets the weights of the net to the result
+             */
+            Report Run();
+
+        protected:
+
+            // Properties
+
+            NeuralNet &m_Net;
+
+            const size_t m_Workers;
+
+            const Options m_Options;
+
+            int m_Listener;
+
+            uint16_t m_Port;
+    };
+
+
+    /**
+     * @brief Train on a shard, syncing with a coordinator after every syncInterval epochs. Returns once every round has been sent and the final weights received
+     *
+     * @param net The net to train, its weights are replaced with the coordinator's to start with
+     * @param shard The examples this worker trains on
+     * @param port The coordinator's loopback port
+     * @param options How to train, must match the coordinator's options
+     */
+    void RunWorker(NeuralNet &net, vector<Example> &shard, uint16_t port, const Options &options);
+
+    /**
+     * @brief Train a net with a number of worker processes forked on this machine, each given a contiguous shard of the examples
+     *
+     * @note fork() only copies the calling thread, so a lock another thread holds at that moment stays locked in every worker. Call this while no other thread is doing anything: no training jobs, streaming trainers, inference, tracing or loops on the executor. The idle default executor is safe, each worker starts its own
+     *
+     * @param net The net to train, which receives the trained weights
+     * @param examples The examples, split between the workers
+     * @param workers The number of worker processes
+     * @param options How to train
+     */
+    Report TrainLocal(NeuralNet &net, const vector<Example> &examples, size_t workers, const Options &options);
+
+    /**
+     * @brief Train copies of a net with TrainLocal at each worker count, and compare their throughput
+     *
+     * @param net The net to copy, which is left untouched
+     * @param examples The examples, split between the workers
+     * @param workerCounts The worker counts to try, the first is the baseline (normally 1)
+     * @param options How to train
+     */
+    vector<ScalingPoint> MeasureScaling(const NeuralNet &net, const vector<Example> &examples, const vector<size_t> &workerCounts, const Options &options);
+
+} // End namespace ai_assignment::distributed
+
+
+#endif // H_530093_SRC_DISTRIBUTED
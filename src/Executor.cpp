@@ -0,0 +1,641 @@
+#include "Executor.hpp"
+
+#include <chrono>
+#include <random>
+#include <thread>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <sched.h>
+#include <pthread.h>
+
+
+namespace ai_assignment
+{
+    namespace
+    {
+        /**
+         * @brief How long a sleeping thread waits before looking around anyway, a backstop rather than part of the protocol
+         */
+        constexpr auto IdleTimeout = std::chrono::milliseconds(10);
+
+        /**
+         * @brief A Chase-Lev work stealing deque. Only the owning worker may Push and Pop, any thread may Steal
+         *
+         * @tparam T The type of the pointers held
+         */
+        template<typename T>
+        class WorkDeque
+        {
+            public:
+
+                WorkDeque()
+                {
+                    this->m_Buffers.push_back(std::make_unique<Buffer>(64));
+                    this->m_Buffer.store(this->m_Buffers.back().get(), std::memory_order_relaxed);
+                }
+
+                WorkDeque(const WorkDeque &obj) = delete;
+
+                /**
+                 * @brief Add an item at the bottom. Owner only
+                 */
+                void Push(T *item)
+                {
+                    int64_t bottom = this->m_Bottom.load(std::memory_order_relaxed);
+                    int64_t top = this->m_Top.load(std::memory_order_acquire);
+                    Buffer *buffer = this->m_Buffer.load(std::memory_order_relaxed);
+
+                    if (bottom - top > static_cast<int64_t>(buffer->mask))
+                    {
+                        buffer = this->Grow(buffer, top, bottom);
+                    }
+
+                    buffer->Put(bottom, item);
+
+                    // Publishes the item to thieves
+                    this->m_Bottom.store(bottom + 1, std::memory_order_release);
+                }
+
+                /**
+                 * @brief Take the item at the bottom, the most recently pushed. Owner only
+                 */
+                T *Pop()
+                {
+                    int64_t bottom = this->m_Bottom.load(std::memory_order_relaxed) - 1;
+                    Buffer *buffer = this->m_Buffer.load(std::memory_order_relaxed);
+
+                    this->m_Bottom.store(bottom, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                    int64_t top = this->m_Top.load(std::memory_order_relaxed);
+
+                    if (top > bottom)
+                    {
+                        // Empty
+                        this->m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+                        return nullptr;
+                    }
+
+                    T *item = buffer->Get(bottom);
+
+                    if (top == bottom)
+                    {
+                        // The last item, race any thieves for it
+                        if (!this->m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) item = nullptr;
+
+                        this->m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+                    }
+
+                    return item;
+                }
+
+                /**
+                 * @brief Take the item at the top, the oldest. Any thread
+                 *
+                 * @return The item, or nullptr if there was nothing or another thread got it first
+                 */
+                T *Steal()
+                {
+                    int64_t top = this->m_Top.load(std::memory_order_acquire);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    int64_t bottom = this->m_Bottom.load(std::memory_order_acquire);
+
+                    if (top >= bottom) return nullptr;
+
+                    T *item = this->m_Buffer.load(std::memory_order_acquire)->Get(top);
+
+                    if (!this->m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+
+                    return item;
+                }
+
+                /**
+                 * @brief The number of items, which may be out of date by the time it's returned
+                 */
+                size_t Size() const noexcept
+                {
+                    int64_t size = this->m_Bottom.load(std::memory_order_relaxed) - this->m_Top.load(std::memory_order_relaxed);
+
+                    return std::max<int64_t>(0, size);
+                }
+
+            private:
+
+                /**
+                 * @brief A ring of item slots, a power of two in size
+                 */
+                struct Buffer
+                {
+                    Buffer(size_t capacity)
+                        : mask(capacity - 1),
+                            slots(new std::atomic<T*>[capacity])
+                    {}
+
+                    T *Get(int64_t i) const noexcept
+                    {
+                        return this->slots[i & this->mask].load(std::memory_order_relaxed);
+                    }
+
+                    void Put(int64_t i, T *item) noexcept
+                    {
+                        this->slots[i & this->mask].store(item, std::memory_order_relaxed);
+                    }
+
+                    const size_t mask;
+                    std::unique_ptr<std::atomic<T*>[]> slots;
+                };
+
+                /**
+                 * @brief Double the buffer. The old one is kept, since thieves may still be reading it
+                 */
+                Buffer *Grow(Buffer *buffer, int64_t top, int64_t bottom)
+                {
+                    this->m_Buffers.push_back(std::make_unique<Buffer>(2 * (buffer->mask + 1)));
+                    Buffer *grown = this->m_Buffers.back().get();
+
+                    for (int64_t i = top; i < bottom; i++) grown->Put(i, buffer->Get(i));
+
+                    this->m_Buffer.store(grown, std::memory_order_release);
+
+                    return grown;
+                }
+
+                std::atomic<int64_t> m_Top = 0;
+                std::atomic<int64_t> m_Bottom = 0;
+                std::atomic<Buffer*> m_Buffer;
+
+                /**
+                 * @brief Every buffer used so far, owner only
+                 */
+                std::vector<std::unique_ptr<Buffer>> m_Buffers;
+        };
+
+        /**
+         * @brief Parse a Linux CPU list, like "0-3,8,10-11"
+         */
+        std::vector<int> parseCpuList(const std::string &list)
+        {
+            auto cpus = std::vector<int>();
+            size_t position = 0;
+
+            while (position < list.size())
+            {
+                size_t end = list.find(',', position);
+                if (end == std::string::npos) end = list.size();
+
+                auto range = list.substr(position, end - position);
+                size_t dash = range.find('-');
+
+                if (!range.empty() && range.find_first_not_of(" \n") != std::string::npos)
+                {
+                    int first = std::stoi(range.substr(0, dash));
+                    int last = (dash == std::string::npos)? first : std::stoi(range.substr(dash + 1));
+
+                    for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+                }
+
+                position = end + 1;
+            }
+
+            return cpus;
+        }
+
+        /**
+         * @brief The CPUs we may run on, narrowed to a NUMA node if one is given
+         */
+        std::vector<int> usableCpus(int numaNode)
+        {
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+
+            if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return {};
+
+            auto cpus = std::vector<int>();
+
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            {
+                if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+            }
+
+            if (numaNode < 0) return cpus;
+
+            auto file = std::ifstream("/sys/devices/system/node/node" + std::to_string(numaNode) + "/cpulist");
+            auto list = std::string();
+
+            if (!file || !std::getline(file, list)) throw std::invalid_argument("No such NUMA node " + std::to_string(numaNode));
+
+            auto nodeCpus = parseCpuList(list);
+
+            std::erase_if(cpus, [&](int cpu) { return std::find(nodeCpus.begin(), nodeCpus.end(), cpu) == nodeCpus.end(); });
+
+            return cpus;
+        }
+
+        void setAffinity(const std::vector<int> &cpus)
+        {
+            if (cpus.empty()) return;
+
+            cpu_set_t set;
+            CPU_ZERO(&set);
+
+            for (int cpu : cpus) CPU_SET(cpu, &set);
+
+            // Best effort, we still work wherever the OS puts us
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+
+        /**
+         * @brief The number of threads an executor runs with, given the CPUs it may use
+         */
+        size_t threadsFor(const Executor::Options &options, const std::vector<int> &cpus)
+        {
+            size_t threads = options.threads;
+
+            // The CPUs we're allowed on rather than every core, so taskset and cpusets don't leave us oversubscribed
+            if (threads == 0) threads = (cpus.empty() && options.numaNode < 0)? std::thread::hardware_concurrency() : cpus.size();
+
+            return std::max<size_t>(1, threads);
+        }
+
+        /**
+         * @brief Guards starting, configuring and resetting the default executor. Using it only needs defaultPointer
+         */
+        std::mutex defaultLock;
+        std::unique_ptr<Executor> defaultExecutor;
+        Executor::Options defaultOptions;
+
+        /**
+         * @brief The default executor once it's started, so each use is a single load
+         */
+        std::atomic<Executor*> defaultPointer = nullptr;
+
+    } // End anonymous namespace
+
+
+    struct Executor::Worker
+    {
+        WorkDeque<Task> deque;
+
+        std::atomic<size_t> tasks = 0;
+        std::atomic<size_t> steals = 0;
+        std::atomic<size_t> failedSteals = 0;
+        std::atomic<uint64_t> idleNanoseconds = 0;
+
+        /**
+         * @brief Picks which worker to steal from first
+         */
+        std::minstd_rand victims;
+
+        std::thread thread;
+    };
+
+    namespace
+    {
+        /**
+         * @brief Which executor and worker the current thread belongs to, if any
+         */
+        thread_local Executor *currentExecutor = nullptr;
+        thread_local void *currentWorker = nullptr;
+
+        /**
+         * @brief Hold the default executor's lock over fork, so the child never inherits it locked by a thread which doesn't exist there
+         */
+        void prepareFork() noexcept
+        {
+            defaultLock.lock();
+        }
+
+        void parentAfterFork() noexcept
+        {
+            defaultLock.unlock();
+        }
+
+        /**
+         * @brief Only the forking thread makes it into the child, so the default executor's workers are gone and its locks may be held by them. Abandon it, since it can't be stopped safely, and start a fresh one on next use
+         */
+        void childAfterFork() noexcept
+        {
+            static_cast<void>(defaultExecutor.release());
+            defaultPointer.store(nullptr, std::memory_order_relaxed);
+
+            currentExecutor = nullptr;
+            currentWorker = nullptr;
+
+            defaultLock.unlock();
+        }
+
+    } // End anonymous namespace
+
+
+    // Public Constructors
+
+
+    Executor::Executor(const Options &options)
+        : m_Options(options)
+    {
+        auto cpus = usableCpus(options.numaNode);
+
+        size_t threads = threadsFor(options, cpus);
+
+        // The thread calling ParallelFor makes up the last one
+        for (size_t i = 0; i + 1 < threads; i++)
+        {
+            this->m_Workers.push_back(std::make_unique<Worker>());
+            this->m_Workers.back()->victims.seed(i + 1);
+        }
+
+        // Start them once they all exist, since they steal from each other
+        for (size_t i = 0; i < this->m_Workers.size(); i++)
+        {
+            auto workerCpus = std::vector<int>();
+
+            if (options.pinThreads && !cpus.empty()) workerCpus = { cpus[i % cpus.size()] };
+            else if (options.numaNode >= 0) workerCpus = cpus;
+
+            this->m_Workers[i]->thread = std::thread(&Executor::WorkerLoop, this, i, std::move(workerCpus));
+        }
+    }
+
+    Executor::~Executor() noexcept
+    {
+        this->m_Stopping.store(true);
+        this->Wake(true);
+
+        for (auto &worker : this->m_Workers)
+        {
+            if (worker->thread.joinable()) worker->thread.join();
+        }
+    }
+
+    Executor &Executor::Default()
+    {
+        Executor *executor = defaultPointer.load(std::memory_order_acquire);
+
+        if (executor != nullptr) return *executor;
+
+        // Only the first use (and the first after a fork) gets this far
+        static std::once_flag forkHandlers;
+
+        std::call_once(forkHandlers, []() { pthread_atfork(prepareFork, parentAfterFork, childAfterFork); });
+
+        auto scopedLock = std::scoped_lock(defaultLock);
+
+        if (!defaultExecutor)
+        {
+            defaultExecutor = std::make_unique<Executor>(defaultOptions);
+            defaultPointer.store(defaultExecutor.get(), std::memory_order_release);
+        }
+
+        return *defaultExecutor;
+    }
+
+    size_t Executor::DefaultThreadCount()
+    {
+        Executor *executor = defaultPointer.load(std::memory_order_acquire);
+
+        if (executor != nullptr) return executor->ThreadCount();
+
+        auto scopedLock = std::scoped_lock(defaultLock);
+
+        if (defaultExecutor) return defaultExecutor->ThreadCount();
+
+        return threadsFor(defaultOptions, usableCpus(defaultOptions.numaNode));
+    }
+
+    void Executor::SetDefaultOptions(const Options &options)
+    {
+        auto scopedLock = std::scoped_lock(defaultLock);
+
+        if (defaultExecutor) throw std::logic_error("The default executor has already started");
+
+        defaultOptions = options;
+    }
+
+
+    // Public Accessors
+
+
+    Executor::Stats Executor::GetStats() const
+    {
+        auto stats = Stats();
+
+        for (auto &worker : this->m_Workers)
+        {
+            auto &out = stats.workers.emplace_back();
+
+            out.tasks = worker->tasks.load(std::memory_order_relaxed);
+            out.steals = worker->steals.load(std::memory_order_relaxed);
+            out.failedSteals = worker->failedSteals.load(std::memory_order_relaxed);
+            out.idleSeconds = worker->idleNanoseconds.load(std::memory_order_relaxed) * 1E-9;
+            out.queueDepth = worker->deque.Size();
+        }
+
+        stats.externalTasks = this->m_ExternalTasks.load(std::memory_order_relaxed);
+        stats.injectedDepth = this->m_InjectedCount.load(std::memory_order_relaxed);
+
+        return stats;
+    }
+
+
+    // Protected Functions
+
+
+    void Executor::Submit(Task *tasks, size_t count)
+    {
+        if (currentExecutor == this)
+        {
+            auto *self = static_cast<Worker*>(currentWorker);
+
+            for (size_t i = 0; i < count; i++) self->deque.Push(tasks + i);
+        }
+        else
+        {
+            auto scopedLock = std::scoped_lock(this->m_InjectLock);
+
+            for (size_t i = 0; i < count; i++) this->m_Injected.push_back(tasks + i);
+
+            this->m_InjectedCount.store(this->m_Injected.size(), std::memory_order_relaxed);
+        }
+
+        this->Wake(false);
+    }
+
+    void Executor::Wait(TaskGroup &group)
+    {
+        auto *self = (currentExecutor == this)? static_cast<Worker*>(currentWorker) : nullptr;
+        size_t spins = 0;
+
+        while (group.pending.load(std::memory_order_acquire) > 0)
+        {
+            // Help out while we wait, which may include tasks of other loops
+            Task *task = this->FindTask(self);
+
+            if (task != nullptr)
+            {
+                this->RunTask(task, self);
+                spins = 0;
+                continue;
+            }
+
+            if (++spins < this->m_Options.spinCount)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // Sleep until a group finishes or there's new work to help with
+            auto lock = std::unique_lock(this->m_SleepLock);
+            uint64_t epoch = this->m_Epoch;
+
+            if (group.pending.load(std::memory_order_acquire) == 0) break;
+
+            this->m_Sleeping.fetch_add(1);
+            this->m_Wake.wait_for(lock, IdleTimeout, [&]() { return this->m_Epoch != epoch; });
+            this->m_Sleeping.fetch_sub(1);
+
+            spins = 0;
+        }
+    }
+
+    Executor::Task *Executor::FindTask(Worker *self)
+    {
+        if (self != nullptr)
+        {
+            Task *task = self->deque.Pop();
+
+            if (task != nullptr) return task;
+        }
+
+        if (this->m_InjectedCount.load(std::memory_order_relaxed) > 0)
+        {
+            auto scopedLock = std::scoped_lock(this->m_InjectLock);
+
+            if (!this->m_Injected.empty())
+            {
+                Task *task = this->m_Injected.front();
+                this->m_Injected.pop_front();
+                this->m_InjectedCount.store(this->m_Injected.size(), std::memory_order_relaxed);
+
+                return task;
+            }
+        }
+
+        size_t workers = this->m_Workers.size();
+
+        if (workers == 0) return nullptr;
+
+        // Start from a random victim so thieves spread out
+        size_t start = (self != nullptr)? self->victims() % workers : 0;
+
+        for (size_t i = 0; i < workers; i++)
+        {
+            auto &victim = *this->m_Workers[(start + i) % workers];
+
+            if (&victim == self) continue;
+
+            Task *task = victim.deque.Steal();
+
+            if (self != nullptr) (task != nullptr)? self->steals++ : self->failedSteals++;
+
+            if (task != nullptr) return task;
+        }
+
+        return nullptr;
+    }
+
+    void Executor::RunTask(Task *task, Worker *self)
+    {
+        TaskGroup *group = task->group;
+
+        task->run(task->context);
+
+        if (self != nullptr) self->tasks.fetch_add(1, std::memory_order_relaxed);
+        else this->m_ExternalTasks.fetch_add(1, std::memory_order_relaxed);
+
+        // The group may be gone as soon as it reaches zero, so don't touch it afterwards
+        if (group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) this->Wake(true);
+    }
+
+    void Executor::Wake(bool always)
+    {
+        // Pairs with the fence in WorkerLoop, either they see our work or we see them sleeping
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (!always && this->m_Sleeping.load() == 0) return;
+
+        {
+            auto scopedLock = std::scoped_lock(this->m_SleepLock);
+
+            this->m_Epoch++;
+        }
+
+        this->m_Wake.notify_all();
+    }
+
+    void Executor::WorkerLoop(size_t index, std::vector<int> cpus)
+    {
+        auto &self = *this->m_Workers[index];
+
+        currentExecutor = this;
+        currentWorker = &self;
+
+        setAffinity(cpus);
+
+        size_t spins = 0;
+
+        while (!this->m_Stopping.load(std::memory_order_relaxed))
+        {
+            Task *task = this->FindTask(&self);
+
+            if (task != nullptr)
+            {
+                this->RunTask(task, &self);
+                spins = 0;
+                continue;
+            }
+
+            if (++spins < this->m_Options.spinCount)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // Say we're going to sleep, then look once more in case work arrived in between
+            uint64_t epoch;
+
+            {
+                auto scopedLock = std::scoped_lock(this->m_SleepLock);
+
+                epoch = this->m_Epoch;
+                this->m_Sleeping.fetch_add(1);
+            }
+
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            task = this->FindTask(&self);
+
+            auto lock = std::unique_lock(this->m_SleepLock);
+
+            if (task == nullptr)
+            {
+                auto start = std::chrono::steady_clock::now();
+
+                this->m_Wake.wait_for(lock, IdleTimeout, [&]() { return this->m_Epoch != epoch || this->m_Stopping.load(); });
+
+                self.idleNanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+            }
+
+            this->m_Sleeping.fetch_sub(1);
+            lock.unlock();
+
+            if (task != nullptr) this->RunTask(task, &self);
+
+            spins = 0;
+        }
+
+        currentExecutor = nullptr;
+        currentWorker = nullptr;
+    }
+
+} // End namespace ai_assignment
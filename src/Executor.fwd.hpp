@@ -0,0 +1,12 @@
+#pragma once
+#ifndef FWD_H_530093_SRC_EXECUTOR
+#define FWD_H_530093_SRC_EXECUTOR 1
+
+namespace ai_assignment
+{
+    class Executor;
+
+} // End namespace ai_assignment
+
+
+#endif // FWD_H_530093_SRC_EXECUTOR
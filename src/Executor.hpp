@@ -0,0 +1,316 @@
+#pragma once
+#ifndef H_530093_SRC_EXECUTOR
+#define H_530093_SRC_EXECUTOR 1
+
+#include "Executor.fwd.hpp"
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <exception>
+#include <condition_variable>
+
+
+namespace ai_assignment
+{
+    /**
+     * @brief A pool of worker threads which balance work by stealing it from each other. Each worker pushes and pops its own tasks at one end of a Chase-Lev deque (Chase & Lev, 2005, with the memory orderings of Lê et al., 2013) while idle workers steal from the other end. Threads outside the pool hand tasks over through a shared queue. A thread waiting on its tasks runs other tasks meanwhile, so parallel loops can nest without starting more threads. Thread safe
+     */
+    class Executor
+    {
+        public:
+
+            // Definitions
+
+            struct Options
+            {
+                /**
+                 * @brief The number of threads running tasks, including the thread which starts a loop. Zero uses one per CPU in the affinity mask (of those on the NUMA node, if one is given)
+                 */
+                size_t threads = 0;
+
+                /**
+                 * @brief Pin each worker to its own CPU, rather than letting the OS move them around
+                 */
+                bool pinThreads = false;
+
+                /**
+                 * @brief Keep the workers on the CPUs of this NUMA node, so they stay close to the memory they touch. Negative uses every CPU
+                 */
+                int numaNode = -1;
+
+                /**
+                 * @brief How many times an idle thread looks for work before going to sleep
+                 */
+                size_t spinCount = 256;
+            };
+
+            struct WorkerStats
+            {
+                size_t tasks = 0;
+
+                /**
+                 * @brief Tasks taken from another worker's deque
+                 */
+                size_t steals = 0;
+
+                /**
+                 * @brief Attempts to steal which found nothing or lost a race
+                 */
+                size_t failedSteals = 0;
+
+                /**
+                 * @brief Time spent asleep waiting for work
+                 */
+                double idleSeconds = 0.0;
+
+                /**
+                 * @brief The number of tasks in the worker's deque right now
+                 */
+                size_t queueDepth = 0;
+            };
+
+            struct Stats
+            {
+                std::vector<WorkerStats> workers;
+
+                /**
+                 * @brief Tasks run by threads outside the pool while waiting on their loops
+                 */
+                size_t externalTasks = 0;
+
+                /**
+                 * @brief The number of tasks handed over by threads outside the pool, waiting to be picked up right now
+                 */
+                size_t injectedDepth = 0;
+            };
+
+
+            // Constructors
+
+
+            /**
+             * @brief Construct an Executor with one thread per core
+             */
+            inline Executor()
+                : Executor(Options())
+            {}
+
+            /**
+             * @brief Construct an Executor, starting its worker threads
+             *
+             * @param options How many threads to start and where to run them
+             */
+            Executor(const Options &options);
+
+            Executor(const Executor &obj) = delete;
+            Executor &operator=(const Executor &obj) = delete;
+
+            /**
+             * @brief Stops and joins the workers. Nothing may be running on the executor
+             */
+            virtual ~Executor() noexcept;
+
+            /**
+             * @brief The executor shared by everything in the library, started on first use. A child process forked from a thread outside the pool starts its own on first use, the parent's is abandoned. Don't hold on to the reference across a fork
+             */
+            static Executor &Default();
+
+            /**
+             * @brief The number of threads the default executor runs, or will start with, without starting it
+             */
+            static size_t DefaultThreadCount();
+
+            /**
+             * @brief Set the options the default executor is started with. Must be called before anything uses it
+             */
+            static void SetDefaultOptions(const Options &options);
+
+            // Accessors
+
+            /**
+             * @brief The number of threads which run tasks, including the calling thread
+             */
+            inline size_t ThreadCount() const noexcept
+            {
+                return this->m_Workers.size() + 1;
+            }
+
+            Stats GetStats() const;
+
+            // Functions
+
+            /**
+             * @brief Calls fn(i) for every i in [0, count), spread over the executor's threads and this one. Returns once every call has finished, then rethrows the first exception any call threw. Can be called from inside another loop
+             *
+             * @tparam Func Callable as fn(size_t)
+             * @param count The number of calls to make
+             * @param fn The function to call
+             * @param threads The most threads to use (including this one), zero uses them all
+             */
+            template<typename Func>
+            inline void ParallelFor(size_t count, Func fn, size_t threads = 0)
+            {
+                size_t width = std::min(count, (threads == 0)? this->ThreadCount() : std::min(threads, this->ThreadCount()));
+
+                if (width <= 1)
+                {
+                    for (size_t i = 0; i < count; i++) fn(i);
+
+                    return;
+                }
+
+                // Every task takes the next index until they run out, which balances uneven calls
+                struct Loop
+                {
+                    Func &fn;
+                    const size_t count;
+                    std::atomic<size_t> next = 0;
+                    std::exception_ptr error = nullptr;
+                    std::mutex errorLock{};
+                } loop{ fn, count };
+
+                auto body = [](void *context)
+                {
+                    auto &loop = *static_cast<Loop*>(context);
+
+                    for (size_t i = loop.next.fetch_add(1, std::memory_order_relaxed); i < loop.count; i = loop.next.fetch_add(1, std::memory_order_relaxed))
+                    {
+                        try
+                        {
+                            loop.fn(i);
+                        }
+                        catch (...)
+                        {
+                            auto scopedLock = std::scoped_lock(loop.errorLock);
+
+                            if (!loop.error) loop.error = std::current_exception();
+                        }
+                    }
+                };
+
+                auto group = TaskGroup();
+                group.pending.store(width - 1, std::memory_order_relaxed);
+
+                auto tasks = std::vector<Task>(width - 1, Task{ body, &loop, &group });
+
+                this->Submit(tasks.data(), tasks.size());
+
+                // Pitch in rather than sitting idle
+                body(&loop);
+
+                this->Wait(group);
+
+                if (loop.error) std::rethrow_exception(loop.error);
+            }
+
+        protected:
+
+            // Definitions
+
+            /**
+             * @brief Counts down as its tasks finish
+             */
+            struct TaskGroup
+            {
+                std::atomic<size_t> pending = 0;
+            };
+
+            /**
+             * @brief A unit of work, owned by whoever submitted it until its group finishes
+             */
+            struct Task
+            {
+                void (*run)(void *context);
+                void *context;
+                TaskGroup *group;
+            };
+
+            /**
+             * @brief A worker thread and its deque, defined in Executor.cpp
+             */
+            struct Worker;
+
+            // Properties
+
+            const Options m_Options;
+
+            std::vector<std::unique_ptr<Worker>> m_Workers;
+
+            /**
+             * @brief Tasks from threads outside the pool
+             */
+            std::deque<Task*> m_Injected;
+
+            std::atomic<size_t> m_InjectedCount = 0;
+
+            /**
+             * @brief A mutex to guard m_Injected
+             */
+            mutable std::mutex m_InjectLock;
+
+            /**
+             * @brief Bumped whenever there's new work or a group finishes, which is what sleeping threads wait for
+             */
+            uint64_t m_Epoch = 0;
+
+            /**
+             * @brief A mutex to guard m_Epoch
+             */
+            std::mutex m_SleepLock;
+
+            std::condition_variable m_Wake;
+
+            /**
+             * @brief The number of threads asleep (or about to be), so submitting only takes m_SleepLock when someone needs waking
+             */
+            std::atomic<size_t> m_Sleeping = 0;
+
+            std::atomic<bool> m_Stopping = false;
+
+            std::atomic<size_t> m_ExternalTasks = 0;
+
+            // Functions
+
+            /**
+             * @brief Queue tasks, on this thread's deque if it's one of our workers
+             */
+            void Submit(Task *tasks, size_t count);
+
+            /**
+             * @brief Run other tasks until every task of a group has finished
+             */
+            void Wait(TaskGroup &group);
+
+            /**
+             * @brief Take a task from our own deque, then the shared queue, then by stealing
+             *
+             * @param self The calling worker, or nullptr for threads outside the pool
+             */
+            Task *FindTask(Worker *self);
+
+            /**
+             * @brief Run a task and count it towards its group
+             */
+            void RunTask(Task *task, Worker *self);
+
+            /**
+             * @brief Wake sleeping threads, if there are any
+             */
+            void Wake(bool always);
+
+            /**
+             * @brief The body of each worker thread
+             */
+            void WorkerLoop(size_t index, std::vector<int> cpus);
+    };
+
+} // End namespace ai_assignment
+
+
+#endif // H_530093_SRC_EXECUTOR
@@ -0,0 +1,200 @@
+#include "InferenceCache.hpp"
+
+#include <cmath>
+#include <bit>
+
+
+namespace ai_assignment
+{
+    // Public Constructors
+
+
+    InferenceCache::InferenceCache(NeuralNet &net, const Options &options)
+        : m_Net(net),
+            m_Options(options),
+            m_ShardCount(std::max<size_t>(1, options.shards)),
+            m_ShardCapacity(std::max<size_t>(1, options.capacity / m_ShardCount)),
+            m_Shards(std::make_unique<Shard[]>(m_ShardCount))
+    {
+        if (options.tolerance < 0.0) throw std::invalid_argument("Tolerance can't be negative");
+    }
+
+
+    // Public Accessors
+
+
+    InferenceCache::Stats InferenceCache::GetStats() const
+    {
+        auto stats = Stats();
+        stats.hits = this->m_Hits.load(std::memory_order_relaxed);
+        stats.misses = this->m_Misses.load(std::memory_order_relaxed);
+        stats.evictions = this->m_Evictions.load(std::memory_order_relaxed);
+        stats.invalidations = this->m_Invalidations.load(std::memory_order_relaxed);
+        stats.bypasses = this->m_Bypasses.load(std::memory_order_relaxed);
+
+        for (size_t s = 0; s < this->m_ShardCount; s++)
+        {
+            auto scopedLock = std::scoped_lock(this->m_Shards[s].lock);
+
+            stats.entries += this->m_Shards[s].entries.size();
+        }
+
+        return stats;
+    }
+
+
+    // Public Functions
+
+
+    vector<double> *InferenceCache::ProcessInputs(const vector<double> &inputs)
+    {
+        auto key = this->Quantise(inputs);
+
+        // Inputs without a key go straight to the net
+        if (!key)
+        {
+            this->m_Bypasses.fetch_add(1, std::memory_order_relaxed);
+
+            return this->m_Net.ProcessInputs(inputs);
+        }
+
+        uint64_t hash = InferenceCache::Hash(*key);
+        auto &shard = this->m_Shards[hash % this->m_ShardCount];
+
+        // Read the version before running the net, so outputs are never tagged newer than the weights they came from
+        uint64_t version = this->m_Net.Version();
+
+        {
+            auto scopedLock = std::scoped_lock(shard.lock);
+            auto slot = shard.slots.find(hash);
+
+            if (slot != shard.slots.end())
+            {
+                auto &entry = shard.entries[slot->second];
+
+                if (entry.key == *key)
+                {
+                    if (entry.version == version)
+                    {
+                        entry.referenced = true;
+                        this->m_Hits.fetch_add(1, std::memory_order_relaxed);
+
+                        return new auto(entry.outputs);
+                    }
+
+                    this->m_Invalidations.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        this->m_Misses.fetch_add(1, std::memory_order_relaxed);
+
+        // Run the net without holding the shard, so other lookups carry on
+        auto *outputs = this->m_Net.ProcessInputs(inputs);
+
+        {
+            auto scopedLock = std::scoped_lock(shard.lock);
+
+            this->Insert(shard, { .hash = hash, .key = std::move(*key), .outputs = *outputs, .version = version, .referenced = false });
+        }
+
+        return outputs;
+    }
+
+    void InferenceCache::Clear()
+    {
+        for (size_t s = 0; s < this->m_ShardCount; s++)
+        {
+            auto &shard = this->m_Shards[s];
+            auto scopedLock = std::scoped_lock(shard.lock);
+
+            shard.entries.clear();
+            shard.slots.clear();
+            shard.hand = 0;
+        }
+    }
+
+
+    // Protected Functions
+
+
+    std::optional<vector<int64_t>> InferenceCache::Quantise(const vector<double> &inputs) const
+    {
+        // Well inside the range of int64_t, llround is unspecified outside it
+        constexpr double KeyLimit = 0x1p62;
+
+        auto key = vector<int64_t>(inputs.size());
+
+        for (size_t i = 0; i < inputs.size(); i++)
+        {
+            if (!std::isfinite(inputs[i])) return std::nullopt;
+
+            if (this->m_Options.tolerance > 0.0)
+            {
+                double steps = inputs[i] / this->m_Options.tolerance;
+
+                if (!(std::fabs(steps) < KeyLimit)) return std::nullopt;
+
+                key[i] = std::llround(steps);
+            }
+            else
+            {
+                // Adding zero turns -0.0 into 0.0, so they match
+                key[i] = std::bit_cast<int64_t>(inputs[i] + 0.0);
+            }
+        }
+
+        return key;
+    }
+
+    uint64_t InferenceCache::Hash(const vector<int64_t> &key) noexcept
+    {
+        uint64_t hash = key.size();
+
+        // Multiply-xorshift mixing of each word, cheap and spreads every input bit across the hash
+        for (int64_t value : key)
+        {
+            hash = (hash ^ static_cast<uint64_t>(value)) * 0x9E3779B97F4A7C15ull;
+            hash ^= hash >> 32;
+        }
+
+        return hash;
+    }
+
+    void InferenceCache::Insert(Shard &shard, Entry entry)
+    {
+        auto slot = shard.slots.find(entry.hash);
+
+        // Replace an entry with the same hash, whether it's stale or another input which collided
+        if (slot != shard.slots.end())
+        {
+            shard.entries[slot->second] = std::move(entry);
+            return;
+        }
+
+        if (shard.entries.size() < this->m_ShardCapacity)
+        {
+            shard.slots[entry.hash] = shard.entries.size();
+            shard.entries.push_back(std::move(entry));
+            return;
+        }
+
+        // Sweep the clock hand round, giving recently used entries a second chance
+        while (shard.entries[shard.hand].referenced)
+        {
+            shard.entries[shard.hand].referenced = false;
+            shard.hand = (shard.hand + 1) % shard.entries.size();
+        }
+
+        auto &victim = shard.entries[shard.hand];
+
+        shard.slots.erase(victim.hash);
+        shard.slots[entry.hash] = shard.hand;
+        victim = std::move(entry);
+
+        shard.hand = (shard.hand + 1) % shard.entries.size();
+
+        this->m_Evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+} // End namespace ai_assignment
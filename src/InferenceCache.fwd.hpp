@@ -0,0 +1,12 @@
+#pragma once
+#ifndef FWD_H_530093_SRC_INFERENCE_CACHE
+#define FWD_H_530093_SRC_INFERENCE_CACHE 1
+
+namespace ai_assignment
+{
+    class InferenceCache;
+
+} // End namespace ai_assignment
+
+
+#endif // FWD_H_530093_SRC_INFERENCE_CACHE
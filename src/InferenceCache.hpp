@@ -0,0 +1,193 @@
+#pragma once
+#ifndef H_530093_SRC_INFERENCE_CACHE
+#define H_530093_SRC_INFERENCE_CACHE 1
+
+#include "InferenceCache.fwd.hpp"
+#include "NeuralNet.fwd.hpp"
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+#include "NeuralNet.hpp"
+
+
+namespace ai_assignment
+{
+    /**
+     * @brief Remembers the outputs of a net for recently seen inputs, in front of NeuralNet::ProcessInputs. Entries are split into shards with their own locks, and evicted with the CLOCK algorithm. Entries go stale whenever the net publishes new weights. Thread safe
+     */
+    class InferenceCache
+    {
+        public:
+
+            // Definitions
+
+            struct Options
+            {
+                /**
+                 * @brief The most entries held, split evenly between the shards
+                 */
+                size_t capacity = 4096;
+
+                /**
+                 * @brief The number of independently locked shards
+                 */
+                size_t shards = 16;
+
+                /**
+                 * @brief Inputs are rounded to a multiple of this before being looked up, so inputs this close share an entry. Zero only matches identical inputs
+                 */
+                double tolerance = 0.0;
+            };
+
+            struct Stats
+            {
+                size_t hits = 0;
+                size_t misses = 0;
+
+                /**
+                 * @brief Entries dropped to make room
+                 */
+                size_t evictions = 0;
+
+                /**
+                 * @brief Lookups which found an entry computed with old weights, these are also misses
+                 */
+                size_t invalidations = 0;
+
+                /**
+                 * @brief Lookups which skipped the cache, since their inputs weren't finite or were too large for the tolerance to round
+                 */
+                size_t bypasses = 0;
+
+                size_t entries = 0;
+            };
+
+
+            // Constructors
+
+
+            /**
+             * @brief Construct an empty cache in front of a net, which must outlive the cache
+             *
+             * @param net The net to run inputs the cache hasn't seen through
+             * @param options How big to make the cache, and how to match inputs
+             */
+            InferenceCache(NeuralNet &net, const Options &options);
+
+            inline InferenceCache(NeuralNet &net)
+                : InferenceCache(net, Options())
+            {}
+
+            InferenceCache(const InferenceCache &obj) = delete;
+            InferenceCache &operator=(const InferenceCache &obj) = delete;
+
+            inline virtual ~InferenceCache() noexcept
+            {}
+
+            // Accessors
+
+            Stats GetStats() const;
+
+            // Functions
+
+            /**
+             * @brief Runs through the net and returns the results, or returns the remembered results if these inputs were seen since the weights last changed. With a tolerance, the results are those of the first inputs seen which round the same way. Inputs which aren't finite, or are too large to round, skip the cache
+             *
+             * @param inputs The inputs to the net, including the bias/threshold
+             * @return vector<double>* The results from the final layer of the network
+             */
+            vector<double> *ProcessInputs(const vector<double> &inputs);
+
+            /**
+             * @brief Forget every entry, keeping the statistics
+             */
+            void Clear();
+
+        protected:
+
+            // Definitions
+
+            struct Entry
+            {
+                uint64_t hash;
+
+                /**
+                 * @brief The rounded inputs, compared on lookup since different inputs may share a hash
+                 */
+                vector<int64_t> key;
+
+                vector<double> outputs;
+
+                /**
+                 * @brief The net's version when the outputs were computed
+                 */
+                uint64_t version;
+
+                /**
+                 * @brief Set on every hit, cleared as the clock hand passes
+                 */
+                bool referenced;
+            };
+
+            struct Shard
+            {
+                std::mutex lock;
+
+                vector<Entry> entries;
+
+                /**
+                 * @brief The slot in entries of each hash
+                 */
+                std::unordered_map<uint64_t, size_t> slots;
+
+                /**
+                 * @brief The next slot the clock hand considers evicting
+                 */
+                size_t hand = 0;
+            };
+
+            // Properties
+
+            NeuralNet &m_Net;
+
+            const Options m_Options;
+
+            const size_t m_ShardCount;
+
+            const size_t m_ShardCapacity;
+
+            std::unique_ptr<Shard[]> m_Shards;
+
+            std::atomic<size_t> m_Hits = 0;
+            std::atomic<size_t> m_Misses = 0;
+            std::atomic<size_t> m_Evictions = 0;
+            std::atomic<size_t> m_Invalidations = 0;
+            std::atomic<size_t> m_Bypasses = 0;
+
+            // Functions
+
+            /**
+             * @brief Round the inputs to the tolerance, or take their bit patterns without one
+             *
+             * @return Nothing if an input isn't finite, or is so large against the tolerance that it can't be rounded to an integer
+             */
+            std::optional<vector<int64_t>> Quantise(const vector<double> &inputs) const;
+
+            static uint64_t Hash(const vector<int64_t> &key) noexcept;
+
+            /**
+             * @brief Add or replace an entry, evicting one if the shard is full. The shard must be locked
+             */
+            void Insert(Shard &shard, Entry entry);
+    };
+
+} // End namespace ai_assignment
+
+
+#endif // H_530093_SRC_INFERENCE_CACHE
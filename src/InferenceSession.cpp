@@ -0,0 +1,190 @@
+#include "InferenceSession.hpp"
+
+#include <stdexcept>
+
+
+namespace ai_assignment
+{
+    // Public Constructors
+
+
+    InferenceSession::InferenceSession(const NeuralNet &net, const Options &options)
+        : m_Net(net),
+            m_Options(options),
+            m_Sums(net.m_NetArchitecture.front()),
+            m_Activations(net.m_NetArchitecture.size() * net.m_Stride)
+    {}
+
+
+    // Public Functions
+
+
+    vector<double> *InferenceSession::ProcessInputs(const vector<double> &inputs)
+    {
+        if (inputs.size() != this->m_Net.m_Inputs) throw std::invalid_argument("Input provided doesn't match architecture");
+
+        if (!this->IsCurrent())
+        {
+            this->m_Inputs = inputs;
+            this->Recompute();
+
+            return this->Finish();
+        }
+
+        // Find what changed, which is cheap next to the multiplications it saves
+        auto changed = vector<size_t>();
+
+        for (size_t k = 0; k < inputs.size(); k++)
+        {
+            if (inputs[k] != this->m_Inputs[k]) changed.push_back(k);
+        }
+
+        if (changed.size() > this->m_Options.maxChangedFraction * inputs.size() || this->m_SinceRecompute >= this->m_Options.recomputeEvery)
+        {
+            this->m_Inputs = inputs;
+            this->Recompute();
+        }
+        else
+        {
+            for (size_t k : changed) this->Update(k, inputs[k]);
+
+            this->m_SinceRecompute++;
+            this->m_DeltaUpdates++;
+        }
+
+        return this->Finish();
+    }
+
+    vector<double> *InferenceSession::ProcessChanges(const vector<std::pair<size_t, double>> &changes)
+    {
+        if (this->m_Inputs.empty()) throw std::logic_error("ProcessChanges needs a previous input, call ProcessInputs first");
+
+        for (auto &change : changes)
+        {
+            if (change.first >= this->m_Inputs.size()) throw std::out_of_range("Changed input is past the end of the inputs");
+        }
+
+        if (!this->IsCurrent() || changes.size() > this->m_Options.maxChangedFraction * this->m_Inputs.size() || this->m_SinceRecompute >= this->m_Options.recomputeEvery)
+        {
+            for (auto &change : changes) this->m_Inputs[change.first] = change.second;
+
+            this->Recompute();
+        }
+        else
+        {
+            for (auto &change : changes) this->Update(change.first, change.second);
+
+            this->m_SinceRecompute++;
+            this->m_DeltaUpdates++;
+        }
+
+        return this->Finish();
+    }
+
+    void InferenceSession::Reset() noexcept
+    {
+        this->m_Inputs.clear();
+        this->m_Weights.clear();
+        this->m_Version = 0;
+    }
+
+
+    // Protected Functions
+
+
+    bool InferenceSession::IsCurrent() const noexcept
+    {
+        return !this->m_Inputs.empty() && this->m_Version == this->m_Net.Version();
+    }
+
+    void InferenceSession::Recompute()
+    {
+        trace::Span recomputeSpan("session recompute", "inference");
+
+        auto &net = this->m_Net;
+        size_t width = net.m_NetArchitecture.front();
+
+        // Read the version first, the weights we get are at least that new
+        uint64_t version = net.Version();
+        auto weights = net.PublishedWeights();
+
+        // Only transpose the first layer again if it changed
+        if (this->m_Weights.empty() || this->m_Weights.front() != weights.front())
+        {
+            const double *layerWeights = weights.front()->Data();
+
+            this->m_Transposed.resize(net.m_Inputs * width);
+
+            for (size_t j = 0; j < width; j++)
+            {
+                for (size_t k = 0; k < net.m_Inputs; k++)
+                {
+                    this->m_Transposed[k * width + j] = layerWeights[j * net.m_Stride + k];
+                }
+            }
+        }
+
+        this->m_Weights = std::move(weights);
+        this->m_Version = version;
+
+        // The same sums Forward makes, in the same order
+        for (size_t j = 0; j < width; j++)
+        {
+            const double *row = this->m_Weights.front()->Data() + j * net.m_Stride;
+            double sum = 0.0;
+
+            for (size_t k = 0; k < net.m_Inputs; k++)
+            {
+                sum += this->m_Inputs[k] * row[k];
+            }
+
+            this->m_Sums[j] = sum;
+        }
+
+        // Values carry over from the inputs past the first layer's outputs
+        std::copy(this->m_Inputs.begin(), this->m_Inputs.end(), this->m_Activations.begin());
+
+        this->m_SinceRecompute = 0;
+        this->m_FullRecomputes++;
+    }
+
+    void InferenceSession::Update(size_t k, double value) noexcept
+    {
+        size_t width = this->m_Sums.size();
+        double delta = value - this->m_Inputs[k];
+        const double *column = this->m_Transposed.data() + k * width;
+
+        for (size_t j = 0; j < width; j++)
+        {
+            this->m_Sums[j] += delta * column[j];
+        }
+
+        this->m_Inputs[k] = value;
+        this->m_Activations[k] = value;
+    }
+
+    vector<double> *InferenceSession::Finish()
+    {
+        auto &net = this->m_Net;
+        size_t width = this->m_Sums.size();
+        double *outputs = this->m_Activations.data();
+
+        // The carried over inputs are already in place, overwrite them with the first layer's outputs
+        for (size_t j = 0; j < width; j++)
+        {
+            outputs[j] = net.m_ActivationFunctions.front()(this->m_Sums[j]);
+        }
+
+        for (size_t i = 1; i < this->m_Weights.size(); i++)
+        {
+            double *layerOutputs = outputs + net.m_Stride;
+
+            net.ForwardLayer(this->m_Weights, i, outputs, layerOutputs);
+
+            outputs = layerOutputs;
+        }
+
+        return new vector<double>(outputs, outputs + net.m_NetArchitecture.back());
+    }
+
+} // End namespace ai_assignment
@@ -0,0 +1,12 @@
+#pragma once
+#ifndef FWD_H_530093_SRC_INFERENCE_SESSION
+#define FWD_H_530093_SRC_INFERENCE_SESSION 1
+
+namespace ai_assignment
+{
+    class InferenceSession;
+
+} // End namespace ai_assignment
+
+
+#endif // FWD_H_530093_SRC_INFERENCE_SESSION
@@ -0,0 +1,168 @@
+#pragma once
+#ifndef H_530093_SRC_INFERENCE_SESSION
+#define H_530093_SRC_INFERENCE_SESSION 1
+
+#include "InferenceSession.fwd.hpp"
+#include "NeuralNet.fwd.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+#include "NeuralNet.hpp"
+
+
+namespace ai_assignment
+{
+    /**
+     * @brief Runs a stream of inputs through a net, keeping the first layer's sums for the last input so inputs which only change in a few places are cheap. Not thread safe, use one session per thread
+     */
+    class InferenceSession
+    {
+        public:
+
+            // Definitions
+
+            struct Options
+            {
+                /**
+                 * @brief Recompute the sums from scratch after this many incremental updates, so rounding errors can't build up
+                 */
+                size_t recomputeEvery = 1024;
+
+                /**
+                 * @brief Recompute from scratch when more than this fraction of the inputs change, since updating would cost more
+                 */
+                double maxChangedFraction = 0.25;
+            };
+
+
+            // Constructors
+
+
+            /**
+             * @brief Start a session on a net, which must outlive the session
+             *
+             * @param net The net to run inputs through
+             * @param options When to recompute the first layer from scratch
+             */
+            InferenceSession(const NeuralNet &net, const Options &options);
+
+            inline InferenceSession(const NeuralNet &net)
+                : InferenceSession(net, Options())
+            {}
+
+            inline virtual ~InferenceSession() noexcept
+            {}
+
+            // Accessors
+
+            /**
+             * @brief The number of inputs processed by updating the first layer's sums
+             */
+            inline size_t DeltaUpdates() const noexcept
+            {
+                return this->m_DeltaUpdates;
+            }
+
+            /**
+             * @brief The number of inputs processed by computing the first layer from scratch
+             */
+            inline size_t FullRecomputes() const noexcept
+            {
+                return this->m_FullRecomputes;
+            }
+
+            // Functions
+
+            /**
+             * @brief Runs through the net and returns the results, only redoing the first layer's work for the inputs which differ from the last call. Uses the net's last published weights
+             *
+             * @param inputs The inputs to the net, including the bias/threshold
+             * @return vector<double>* The results from the final layer of the network
+             */
+            vector<double> *ProcessInputs(const vector<double> &inputs);
+
+            /**
+             * @brief As ProcessInputs, given only the inputs which changed since the last call. The first call must be to ProcessInputs
+             *
+             * @param changes Pairs of input index and new value
+             * @return vector<double>* The results from the final layer of the network
+             */
+            vector<double> *ProcessChanges(const vector<std::pair<size_t, double>> &changes);
+
+            /**
+             * @brief Forget the last input, the next call recomputes from scratch
+             */
+            void Reset() noexcept;
+
+        protected:
+
+            // Properties
+
+            const NeuralNet &m_Net;
+
+            const Options m_Options;
+
+            /**
+             * @brief The weights the sums were computed with
+             */
+            NeuralNet::weight_set_type m_Weights;
+
+            /**
+             * @brief The net's version when m_Weights was taken, zero before the first call
+             */
+            uint64_t m_Version = 0;
+
+            /**
+             * @brief The first layer's weights transposed, one row of neurons per input, so an input's contribution to every sum is contiguous
+             */
+            vector<double> m_Transposed;
+
+            /**
+             * @brief The last inputs
+             */
+            vector<double> m_Inputs;
+
+            /**
+             * @brief The first layer's sums before activation for m_Inputs
+             */
+            vector<double> m_Sums;
+
+            /**
+             * @brief The outputs of every layer, one row of the net's stride per layer. The first row's carried over values are kept up to date with m_Inputs
+             */
+            vector<double> m_Activations;
+
+            size_t m_SinceRecompute = 0;
+
+            size_t m_DeltaUpdates = 0;
+            size_t m_FullRecomputes = 0;
+
+            // Functions
+
+            /**
+             * @brief Whether the sums were computed with the weights the net has published since
+             */
+            bool IsCurrent() const noexcept;
+
+            /**
+             * @brief Compute the first layer's sums for m_Inputs from scratch, with the latest published weights
+             */
+            void Recompute();
+
+            /**
+             * @brief Move the sums for input k to a new value
+             */
+            void Update(size_t k, double value) noexcept;
+
+            /**
+             * @brief Run the rest of the net from the first layer's sums
+             */
+            vector<double> *Finish();
+    };
+
+} // End namespace ai_assignment
+
+
+#endif // H_530093_SRC_INFERENCE_SESSION
@@ -0,0 +1,145 @@
+#include "Initialiser.hpp"
+
+#include <cmath>
+#include <random>
+#include <numbers>
+#include <algorithm>
+
+#include "utils.hpp"
+
+
+namespace ai_assignment
+{
+    namespace
+    {
+        /**
+         * @brief Layers with fewer weights than this are filled on the calling thread, starting threads would take longer
+         */
+        constexpr size_t MinimumParallelWeights = 64 * 1024;
+
+        uint64_t randomSeed()
+        {
+            std::random_device rng;
+
+            return (static_cast<uint64_t>(rng()) << 32) | rng();
+        }
+
+    } // End anonymous namespace
+
+
+    // Public Constructors
+
+
+    Initialiser::Initialiser(const Options &options)
+        : m_Options(options),
+            m_Seed(options.seed.has_value()? *options.seed : randomSeed()),
+            m_Generator(m_Seed)
+    {}
+
+
+    // Public Functions
+
+
+    void Initialiser::Fill(double *weights, size_t neurons, size_t inputs, size_t stride, uint64_t stream) const
+    {
+        if (inputs == 0) return;
+
+        // The bias isn't a real input, and each input feeds every neuron of the layer
+        size_t fanIn = std::max<size_t>(1, inputs - 1);
+        size_t fanOut = std::max<size_t>(1, neurons);
+        bool normal = this->m_Options.distribution == Distribution::Normal;
+        double scale;
+
+        // Uniform(-a, a) has variance a²/3, so the uniform limit is √3 times the normal standard deviation
+        switch (this->m_Options.scheme)
+        {
+            case Scheme::Xavier:
+                scale = std::sqrt((normal? 2.0 : 6.0) / (fanIn + fanOut));
+                break;
+
+            case Scheme::He:
+                scale = std::sqrt((normal? 2.0 : 6.0) / fanIn);
+                break;
+
+            default:
+                scale = this->m_Options.range;
+                normal = false;
+                break;
+        }
+
+        // Each neuron starts at an even position so values come in whole pairs
+        uint64_t rowLength = (inputs + 1) & ~static_cast<uint64_t>(1);
+
+        auto fillNeurons = [&](size_t begin, size_t end)
+        {
+            for (size_t j = begin; j < end; j++)
+            {
+                double *row = weights + j * stride;
+
+                this->FillRow(row, inputs - 1, scale, normal, stream, j * rowLength);
+                row[inputs - 1] = this->m_Options.bias;
+            }
+        };
+
+        // Small layers are filled here, without starting the shared executor
+        if (neurons * inputs < MinimumParallelWeights)
+        {
+            fillNeurons(0, neurons);
+
+            return;
+        }
+
+        size_t threads = utils::threadCount(this->m_Options.threads);
+
+        if (threads <= 1)
+        {
+            fillNeurons(0, neurons);
+
+            return;
+        }
+
+        // A few chunks per thread evens out the load, the values don't depend on the split
+        size_t chunks = std::min(neurons, threads * 4);
+
+        utils::parallelFor(chunks, [&](size_t c)
+        {
+            fillNeurons(neurons * c / chunks, neurons * (c + 1) / chunks);
+        }, threads);
+    }
+
+
+    // Protected Functions
+
+
+    void Initialiser::FillRow(double *weights, size_t count, double scale, bool normal, uint64_t stream, uint64_t offset) const noexcept
+    {
+        // Each call of the generator gives two doubles
+        for (size_t k = 0; k < count; k += 2)
+        {
+            auto words = this->m_Generator(stream, (offset + k) / 2);
+
+            double first = Philox::ToUnit(words[0], words[1]);
+            double second = Philox::ToUnit(words[2], words[3]);
+
+            if (normal)
+            {
+                // Box-Muller, 1 - u keeps us away from log(0)
+                double radius = scale * std::sqrt(-2.0 * std::log(1.0 - first));
+                double angle = 2.0 * std::numbers::pi * second;
+
+                first = radius * std::cos(angle);
+                second = radius * std::sin(angle);
+            }
+            else
+            {
+                first = scale * (2.0 * first - 1.0);
+                second = scale * (2.0 * second - 1.0);
+            }
+
+            weights[k] = first;
+
+            if (k + 1 < count) weights[k + 1] = second;
+        }
+    }
+
+} // End namespace ai_assignment
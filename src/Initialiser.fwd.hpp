@@ -0,0 +1,13 @@
+#pragma once
+#ifndef FWD_H_530093_SRC_INITIALISER
+#define FWD_H_530093_SRC_INITIALISER 1
+
+namespace ai_assignment
+{
+    class Philox;
+    class Initialiser;
+
+} // End namespace ai_assignment
+
+
+#endif // FWD_H_530093_SRC_INITIALISER
@@ -0,0 +1,219 @@
+#pragma once
+#ifndef H_530093_SRC_INITIALISER
+#define H_530093_SRC_INITIALISER 1
+
+#include "Initialiser.fwd.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+
+
+namespace ai_assignment
+{
+    /**
+     * @brief The Philox4x32-10 counter based generator (Salmon et al., 2011). Each counter maps to four random words with no state carried between calls, so any part of a sequence can be generated on any thread
+     */
+    class Philox
+    {
+        public:
+
+            // Definitions
+
+            typedef std::array<uint32_t, 4> result_type;
+
+
+            // Constructors
+
+
+            inline Philox(uint64_t key) noexcept
+                : m_Key(key)
+            {}
+
+            // Functions
+
+            /**
+             * @brief The four random words for a counter
+             *
+             * @param high The high half of the counter, normally picks the stream
+             * @param low The low half of the counter, normally the position in the stream
+             */
+            inline result_type operator()(uint64_t high, uint64_t low) const noexcept
+            {
+                result_type counter = {
+                    static_cast<uint32_t>(low), static_cast<uint32_t>(low >> 32),
+                    static_cast<uint32_t>(high), static_cast<uint32_t>(high >> 32)
+                };
+
+                uint32_t key0 = static_cast<uint32_t>(this->m_Key);
+                uint32_t key1 = static_cast<uint32_t>(this->m_Key >> 32);
+
+                for (size_t round = 0; round < 10; round++)
+                {
+                    uint64_t product0 = static_cast<uint64_t>(0xD2511F53u) * counter[0];
+                    uint64_t product1 = static_cast<uint64_t>(0xCD9E8D57u) * counter[2];
+
+                    counter = {
+                        static_cast<uint32_t>(product1 >> 32) ^ counter[1] ^ key0,
+                        static_cast<uint32_t>(product1),
+                        static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ key1,
+                        static_cast<uint32_t>(product0)
+                    };
+
+                    // Bump the key with the Weyl sequence
+                    key0 += 0x9E3779B9u;
+                    key1 += 0xBB67AE85u;
+                }
+
+                return counter;
+            }
+
+            /**
+             * @brief Turn two random words into a double in [0, 1) with the full 53 bits of precision
+             */
+            static inline double ToUnit(uint32_t high, uint32_t low) noexcept
+            {
+                uint64_t bits = (static_cast<uint64_t>(high) << 32) | low;
+
+                return (bits >> 11) * 0x1.0p-53;
+            }
+
+        protected:
+
+            // Properties
+
+            const uint64_t m_Key;
+    };
+
+
+    /**
+     * @brief Fills weights with random starting values. Every value depends only on the seed and where it is, so the same seed gives the same weights however many threads fill them. Thread safe
+     */
+    class Initialiser
+    {
+        public:
+
+            // Definitions
+
+            enum class Scheme
+            {
+                // Uniform in (-range, range)
+                Uniform,
+                // Glorot & Bengio (2010), keeps the variance of activations and gradients roughly equal across layers. Suits sigmoid and tanh
+                Xavier,
+                // He et al. (2015), Xavier adjusted for units which zero half their inputs. Suits ReLU
+                He
+            };
+
+            /**
+             * @brief The shape of the distribution used by Xavier and He, which both have the same variance either way
+             */
+            enum class Distribution
+            {
+                Uniform,
+                Normal
+            };
+
+            struct Options
+            {
+                Scheme scheme = Scheme::Uniform;
+
+                Distribution distribution = Distribution::Uniform;
+
+                /**
+                 * @brief The half width of the Uniform scheme
+                 */
+                double range = 0.05;
+
+                /**
+                 * @brief The starting value of the last (bias/threshold) weight of each neuron
+                 */
+                double bias = 1.0;
+
+                /**
+                 * @brief The seed, drawn from std::random_device once per initialiser if empty
+                 */
+                std::optional<uint64_t> seed;
+
+                /**
+                 * @brief The number of threads to fill large layers with, zero uses one per core
+                 */
+                size_t threads = 0;
+            };
+
+
+            // Constructors
+
+
+            /**
+             * @brief Construct an Initialiser matching the original behaviour, uniform in (-0.05, 0.05) with a bias weight of 1.0, and a random seed
+             */
+            inline Initialiser()
+                : Initialiser(Options())
+            {}
+
+            /**
+             * @brief Construct a new Initialiser
+             *
+             * @param options The scheme to use and how to seed it
+             */
+            Initialiser(const Options &options);
+
+            // Accessors
+
+            inline const Options &GetOptions() const noexcept
+            {
+                return this->m_Options;
+            }
+
+            /**
+             * @brief The seed in use, so a randomly seeded net can be reproduced
+             */
+            inline uint64_t Seed() const noexcept
+            {
+                return this->m_Seed;
+            }
+
+            // Functions
+
+            /**
+             * @brief Fill a layer of neurons with starting weights
+             *
+             * @param weights The first neuron's weights, each neuron's weights start stride values after the last's
+             * @param neurons The number of neurons in the layer
+             * @param inputs The number of weights each neuron has, including the bias/threshold which is set to the bias option
+             * @param stride The distance between neurons, at least inputs. Padding is left alone
+             * @param stream Which stream of random values to use, layers of one net should use different streams
+             */
+            void Fill(double *weights, size_t neurons, size_t inputs, size_t stride, uint64_t stream) const;
+
+        protected:
+
+            // Properties
+
+            const Options m_Options;
+
+            const uint64_t m_Seed;
+
+            const Philox m_Generator;
+
+            // Functions
+
+            /**
+             * @brief Fill one neuron's weights, excluding the bias
+             *
+             * @param weights Where to write
+             * @param count The number of weights to write
+             * @param scale The half width of a uniform distribution, or standard deviation of a normal one
+             * @param normal Whether to draw from a normal distribution
+             * @param stream The stream to draw from
+             * @param offset The position in the stream of the first weight, must be even
+             */
+            void FillRow(double *weights, size_t count, double scale, bool normal, uint64_t stream, uint64_t offset) const noexcept;
+    };
+
+} // End namespace ai_assignment
+
+
+#endif // H_530093_SRC_INITIALISER
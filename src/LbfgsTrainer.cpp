@@ -0,0 +1,582 @@
+#include "LbfgsTrainer.hpp"
+
+#include <cmath>
+#include <deque>
+#include <optional>
+#include <algorithm>
+#include <limits>
+#include <iomanip>
+#include <numeric>
+#include <stdexcept>
+
+#include "utils.hpp"
+#include "Trace.hpp"
+#include "Autotuner.hpp"
+#include "activation_functions.hpp"
+
+
+namespace ai_assignment
+{
+    namespace
+    {
+        /**
+         * @brief The sufficient decrease and curvature constants of the Wolfe conditions, the usual choices for quasi-Newton methods
+         */
+        constexpr double Armijo = 1E-4;
+        constexpr double Curvature = 0.9;
+
+        /**
+         * @brief How to differentiate a layer's activation function
+         */
+        enum class Derivative
+        {
+            Sigmoid,
+            Tanh,
+            Identity,
+            Step,
+            // Anything else, by central differences
+            Numeric
+        };
+
+        Derivative derivativeOf(const Neuron::activation_func_type &function)
+        {
+            typedef double (*function_pointer)(const double&);
+
+            const function_pointer *target = function.target<function_pointer>();
+
+            if (target == nullptr) return Derivative::Numeric;
+
+            if (*target == activation_functions::sigmoidFunc) return Derivative::Sigmoid;
+            if (*target == activation_functions::tanhFunc) return Derivative::Tanh;
+            if (*target == activation_functions::noFunc) return Derivative::Identity;
+            if (*target == activation_functions::stepFunc) return Derivative::Step;
+
+            return Derivative::Numeric;
+        }
+
+        /**
+         * @brief The slope of the activation function at net, which gave out
+         */
+        inline double slope(Derivative derivative, const Neuron::activation_func_type &function, double net, double out)
+        {
+            switch (derivative)
+            {
+                case Derivative::Sigmoid: return out * (1.0 - out);
+                case Derivative::Tanh: return 1.0 - out * out;
+                case Derivative::Identity: return 1.0;
+                case Derivative::Step: return 0.0;
+                case Derivative::Numeric: break;
+            }
+
+            double h = 1E-6 * std::max(1.0, std::abs(net));
+
+            return (function(net + h) - function(net - h)) / (2.0 * h);
+        }
+
+        inline double dot(const vector<double> &a, const vector<double> &b)
+        {
+            return std::inner_product(a.begin(), a.end(), b.begin(), 0.0);
+        }
+
+        /**
+         * @brief Where each layer starts in a row layout of weights, with the total at the end
+         */
+        vector<size_t> layerOffsets(const vector<size_t> &netArchitecture, size_t stride)
+        {
+            auto offsets = vector<size_t>(netArchitecture.size() + 1);
+
+            for (size_t i = 0; i < netArchitecture.size(); i++) offsets[i + 1] = offsets[i] + netArchitecture[i] * stride;
+
+            return offsets;
+        }
+
+    } // End anonymous namespace
+
+
+    // Public Constructors
+
+
+    LbfgsTrainer::LbfgsTrainer(const Options &options)
+        : m_Options(options)
+    {
+        if (options.history == 0) throw std::invalid_argument("L-BFGS needs a history of at least one step");
+    }
+
+
+    // Public Functions
+
+
+    LbfgsTrainer::Result LbfgsTrainer::Train(NeuralNet &net, const vector<Example> &examples) const
+    {
+        if (examples.empty()) throw std::invalid_argument("No examples to train on");
+
+        trace::Span lockSpan("lock", "sync");
+        auto scopedLock = std::scoped_lock(net.m_Lock);
+        lockSpan.End();
+
+        auto result = Result();
+
+        auto x = LbfgsTrainer::ReadWeights(net);
+        auto g = vector<double>();
+        double f = this->Evaluate(net, x, examples, g);
+        double gradientNorm = std::sqrt(dot(g, g));
+
+        result.evaluations = 1;
+
+        // The most recent steps and the changes in gradient they made, oldest first
+        struct Correction
+        {
+            vector<double> s;
+            vector<double> y;
+            double rho;
+        };
+
+        auto history = std::deque<Correction>();
+
+        if (this->m_Options.errLog != nullptr) *this->m_Options.errLog << std::setprecision(std::numeric_limits<double>::digits10 + 1);
+
+        // A point along the search direction
+        struct Point
+        {
+            double alpha;
+            double f;
+            double slope;
+            vector<double> x;
+            vector<double> g;
+        };
+
+        auto d = vector<double>(x.size());
+
+        result.reason = Stop::GradientTolerance;
+
+        while (gradientNorm > this->m_Options.gradientTolerance)
+        {
+            if (result.epochs == this->m_Options.maxEpochs)
+            {
+                result.reason = Stop::MaxEpochs;
+                break;
+            }
+
+            trace::Span epochSpan("epoch", "train", result.epochs + 1);
+
+            // The two loop recursion, d = -H g
+            {
+                d = g;
+
+                auto a = vector<double>(history.size());
+
+                for (size_t i = history.size(); i-- > 0;)
+                {
+                    a[i] = history[i].rho * dot(history[i].s, d);
+
+                    for (size_t n = 0; n < d.size(); n++) d[n] -= a[i] * history[i].y[n];
+                }
+
+                // Scale by the curvature of the latest step
+                double gamma = history.empty()? 1.0 : dot(history.back().s, history.back().y) / dot(history.back().y, history.back().y);
+
+                for (auto &value : d) value *= gamma;
+
+                for (size_t i = 0; i < history.size(); i++)
+                {
+                    double b = history[i].rho * dot(history[i].y, d);
+
+                    for (size_t n = 0; n < d.size(); n++) d[n] += history[i].s[n] * (a[i] - b);
+                }
+
+                for (auto &value : d) value = -value;
+            }
+
+            double slope0 = dot(g, d);
+
+            // Rounding can leave us pointing uphill, so start again from steepest descent
+            if (!(slope0 < 0.0))
+            {
+                history.clear();
+
+                for (size_t n = 0; n < d.size(); n++) d[n] = -g[n];
+
+                slope0 = -gradientNorm * gradientNorm;
+            }
+
+            // Steepest descent has no idea of scale, so take a step of unit length to begin with
+            double alpha = history.empty()? std::min(1.0, 1.0 / gradientNorm) : 1.0;
+
+            size_t searches = 0;
+
+            auto evaluateAt = [&](double alpha) -> Point
+            {
+                auto point = Point{ .alpha = alpha, .f = 0.0, .slope = 0.0, .x = x, .g = {} };
+
+                for (size_t n = 0; n < d.size(); n++) point.x[n] += alpha * d[n];
+
+                point.f = this->Evaluate(net, point.x, examples, point.g);
+                point.slope = dot(point.g, d);
+
+                result.evaluations++;
+                searches++;
+
+                return point;
+            };
+
+            auto sufficientDecrease = [&](const Point &point)
+            {
+                return std::isfinite(point.f) && point.f <= f + Armijo * point.alpha * slope0;
+            };
+
+            auto accepted = std::optional<Point>();
+
+            // Narrow an interval known to hold a point meeting the strong Wolfe conditions, lo always decreases the error enough
+            auto zoom = [&](Point lo, Point hi)
+            {
+                while (searches < this->m_Options.maxLineSearch)
+                {
+                    double width = hi.alpha - lo.alpha;
+                    double denominator = 2.0 * (hi.f - lo.f - lo.slope * width);
+
+                    // Minimise the quadratic through both ends, kept away from the ends in case it's a poor fit
+                    double trial = (std::isfinite(hi.f) && denominator > 0.0)? lo.alpha - lo.slope * width * width / denominator : lo.alpha + width / 2.0;
+
+                    double low = std::min(lo.alpha, hi.alpha) + 0.1 * std::abs(width);
+                    double high = std::max(lo.alpha, hi.alpha) - 0.1 * std::abs(width);
+
+                    auto point = evaluateAt(std::clamp(trial, low, high));
+
+                    if (!sufficientDecrease(point) || point.f >= lo.f)
+                    {
+                        hi = std::move(point);
+                        continue;
+                    }
+
+                    if (std::abs(point.slope) <= -Curvature * slope0)
+                    {
+                        accepted = std::move(point);
+                        return;
+                    }
+
+                    if (point.slope * width >= 0.0) hi = std::move(lo);
+
+                    lo = std::move(point);
+                }
+
+                // Out of passes, settle for a step which at least lowers the error
+                if (lo.alpha > 0.0) accepted = std::move(lo);
+            };
+
+            {
+                trace::Span searchSpan("line search", "train");
+
+                auto previous = Point{ .alpha = 0.0, .f = f, .slope = slope0, .x = x, .g = g };
+
+                while (!accepted && searches < this->m_Options.maxLineSearch)
+                {
+                    auto point = evaluateAt(alpha);
+
+                    if (!sufficientDecrease(point) || (previous.alpha > 0.0 && point.f >= previous.f))
+                    {
+                        zoom(std::move(previous), std::move(point));
+                        break;
+                    }
+
+                    if (std::abs(point.slope) <= -Curvature * slope0)
+                    {
+                        accepted = std::move(point);
+                        break;
+                    }
+
+                    if (point.slope >= 0.0)
+                    {
+                        zoom(std::move(point), std::move(previous));
+                        break;
+                    }
+
+                    previous = std::move(point);
+                    alpha *= 2.0;
+                }
+
+                if (!accepted && previous.alpha > 0.0 && searches >= this->m_Options.maxLineSearch) accepted = std::move(previous);
+            }
+
+            if (!accepted)
+            {
+                result.reason = Stop::LineSearchFailed;
+                break;
+            }
+
+            result.epochs++;
+
+            // Remember the step, as long as it shows the positive curvature the update needs
+            auto correction = Correction{ .s = vector<double>(x.size()), .y = vector<double>(x.size()), .rho = 0.0 };
+
+            for (size_t n = 0; n < x.size(); n++)
+            {
+                correction.s[n] = accepted->x[n] - x[n];
+                correction.y[n] = accepted->g[n] - g[n];
+            }
+
+            double sy = dot(correction.s, correction.y);
+
+            if (sy > std::numeric_limits<double>::epsilon() * dot(correction.y, correction.y))
+            {
+                correction.rho = 1.0 / sy;
+
+                history.push_back(std::move(correction));
+
+                if (history.size() > this->m_Options.history) history.pop_front();
+            }
+
+            double previousF = f;
+
+            x = std::move(accepted->x);
+            g = std::move(accepted->g);
+            f = accepted->f;
+            gradientNorm = std::sqrt(dot(g, g));
+
+            // Every epoch lowers the error, so they're all good enough to run inference against
+            LbfgsTrainer::WriteWeights(net, x);
+            net.PublishWeights();
+
+            if (this->m_Options.errLog != nullptr) *this->m_Options.errLog << result.epochs << ',' << f << '\n';
+
+            if (previousF - f <= this->m_Options.relativeTolerance * std::max({ std::abs(previousF), std::abs(f), std::numeric_limits<double>::min() }))
+            {
+                result.reason = Stop::RelativeTolerance;
+                break;
+            }
+        }
+
+        if (this->m_Options.errLog != nullptr) this->m_Options.errLog->flush();
+
+        result.mse = f;
+        result.gradientNorm = gradientNorm;
+
+        return result;
+    }
+
+    double LbfgsTrainer::Gradient(const NeuralNet &net, const vector<Example> &examples, vector<double> &gradient) const
+    {
+        if (examples.empty()) throw std::invalid_argument("No examples to take the gradient over");
+
+        auto weights = vector<double>();
+
+        {
+            auto scopedLock = std::scoped_lock(net.m_Lock);
+
+            weights = LbfgsTrainer::ReadWeights(net);
+        }
+
+        auto rows = vector<double>();
+        double mse = this->Evaluate(net, weights, examples, rows);
+
+        // Drop the padding, to match GetParameters
+        gradient.clear();
+        gradient.reserve(net.ParameterCount());
+
+        for (size_t row = 0; row < rows.size(); row += net.m_Stride)
+        {
+            gradient.insert(gradient.end(), rows.begin() + row, rows.begin() + row + net.m_Inputs);
+        }
+
+        return mse;
+    }
+
+
+    // Protected Functions
+
+
+    double LbfgsTrainer::Evaluate(const NeuralNet &net, const vector<double> &weights, const vector<Example> &examples, vector<double> &gradient) const
+    {
+        auto &architecture = net.m_NetArchitecture;
+        size_t layerCount = architecture.size();
+        size_t stride = net.m_Stride;
+        size_t inputCount = net.m_Inputs;
+        size_t outputCount = architecture.back();
+        size_t batchSize = NeuralNet::ForwardBatchSize;
+
+        auto offsets = layerOffsets(architecture, stride);
+        auto derivatives = vector<Derivative>(layerCount);
+
+        for (size_t i = 0; i < layerCount; i++) derivatives[i] = derivativeOf(net.m_ActivationFunctions[i]);
+
+        for (auto &example : examples)
+        {
+            if (example.inputs.size() != inputCount) throw std::invalid_argument("Input provided doesn't match architecture");
+            if (example.targetOutput.size() != outputCount) throw std::invalid_argument("Target output doesn't match architecture");
+        }
+
+        // The kernels leave the activation to us, since the backward pass needs the weighted sums as well
+        static const auto identity = Autotuner::activation_func_type(activation_functions::noFunc);
+
+        // The sums for each shard, fixed in size like Evaluate so the order of summing never changes
+        struct Partial
+        {
+            double squaredError = 0.0;
+            vector<double> gradient;
+        };
+
+        size_t shards = (examples.size() + NeuralNet::EvaluationShardSize - 1) / NeuralNet::EvaluationShardSize;
+        auto partials = vector<Partial>(shards);
+
+        utils::parallelFor(shards, [&](size_t s)
+        {
+            trace::Span shardSpan("gradient shard", "train", s);
+
+            auto &partial = partials[s];
+            partial.gradient.assign(weights.size(), 0.0);
+
+            size_t begin = s * NeuralNet::EvaluationShardSize;
+            size_t end = std::min(examples.size(), begin + NeuralNet::EvaluationShardSize);
+
+            // The inputs to each layer and the outputs of the last, then the weighted sums of each layer, one row per example
+            auto activations = vector<double>((layerCount + 1) * batchSize * stride);
+            auto sums = vector<double>(layerCount * batchSize * stride);
+            // The gradient of the error with respect to a layer's outputs, and to its inputs
+            auto outputErrors = vector<double>(batchSize * stride);
+            auto inputErrors = vector<double>(batchSize * stride);
+
+            for (size_t batchStart = begin; batchStart < end; batchStart += batchSize)
+            {
+                size_t count = std::min(batchSize, end - batchStart);
+
+                for (size_t b = 0; b < count; b++)
+                {
+                    std::copy_n(examples[batchStart + b].inputs.data(), inputCount, activations.data() + b * stride);
+                }
+
+                // Forward, keeping every layer
+                for (size_t i = 0; i < layerCount; i++)
+                {
+                    const double *layerInputs = activations.data() + i * batchSize * stride;
+                    double *outputs = activations.data() + (i + 1) * batchSize * stride;
+                    double *layerSums = sums.data() + i * batchSize * stride;
+                    auto &activationFunction = net.m_ActivationFunctions[i];
+
+                    Autotuner::Run(net.m_BatchKernels[i], net.LayerShape(i, count), weights.data() + offsets[i], layerInputs, layerSums, identity);
+
+                    // Values carry over to the next layer until a neuron overwrites them
+                    std::copy_n(layerInputs, count * stride, outputs);
+
+                    for (size_t b = 0; b < count; b++)
+                    {
+                        for (size_t j = 0; j < architecture[i]; j++) outputs[b * stride + j] = activationFunction(layerSums[b * stride + j]);
+                    }
+                }
+
+                // The error, and its gradient with respect to the outputs
+                const double *out = activations.data() + layerCount * batchSize * stride;
+
+                std::fill_n(outputErrors.begin(), count * stride, 0.0);
+
+                for (size_t b = 0; b < count; b++)
+                {
+                    const double *target = examples[batchStart + b].targetOutput.data();
+
+                    for (size_t k = 0; k < outputCount; k++)
+                    {
+                        double error = target[k] - out[b * stride + k];
+
+                        partial.squaredError += error * error;
+                        outputErrors[b * stride + k] = -2.0 * error;
+                    }
+                }
+
+                // Backward
+                for (size_t i = layerCount; i-- > 0;)
+                {
+                    const double *layerInputs = activations.data() + i * batchSize * stride;
+                    const double *outputs = layerInputs + batchSize * stride;
+                    const double *layerSums = sums.data() + i * batchSize * stride;
+                    const double *layerWeights = weights.data() + offsets[i];
+                    double *layerGradient = partial.gradient.data() + offsets[i];
+                    size_t width = architecture[i];
+
+                    // Through the activation function, giving the gradient with respect to the sums
+                    for (size_t b = 0; b < count; b++)
+                    {
+                        for (size_t j = 0; j < width; j++)
+                        {
+                            double &error = outputErrors[b * stride + j];
+
+                            error *= slope(derivatives[i], net.m_ActivationFunctions[i], layerSums[b * stride + j], outputs[b * stride + j]);
+                        }
+                    }
+
+                    for (size_t j = 0; j < width; j++)
+                    {
+                        double *row = layerGradient + j * stride;
+
+                        for (size_t b = 0; b < count; b++)
+                        {
+                            double error = outputErrors[b * stride + j];
+                            const double *x = layerInputs + b * stride;
+
+                            if (error == 0.0) continue;
+
+                            for (size_t k = 0; k < inputCount; k++) row[k] += error * x[k];
+                        }
+                    }
+
+                    if (i == 0) break;
+
+                    // Back to the inputs, which either fed the neurons or carried straight over
+                    for (size_t b = 0; b < count; b++)
+                    {
+                        const double *errors = outputErrors.data() + b * stride;
+                        double *previousErrors = inputErrors.data() + b * stride;
+
+                        for (size_t k = 0; k < inputCount; k++) previousErrors[k] = (k < width)? 0.0 : errors[k];
+
+                        for (size_t j = 0; j < width; j++)
+                        {
+                            const double *row = layerWeights + j * stride;
+
+                            for (size_t k = 0; k < inputCount; k++) previousErrors[k] += errors[j] * row[k];
+                        }
+                    }
+
+                    std::swap(outputErrors, inputErrors);
+                }
+            }
+        }, this->m_Options.threads);
+
+        // Combine the shards in order
+        double squaredError = 0.0;
+
+        gradient.assign(weights.size(), 0.0);
+
+        for (auto &partial : partials)
+        {
+            squaredError += partial.squaredError;
+
+            for (size_t n = 0; n < gradient.size(); n++) gradient[n] += partial.gradient[n];
+        }
+
+        for (auto &value : gradient) value /= examples.size();
+
+        return squaredError / examples.size();
+    }
+
+    vector<double> LbfgsTrainer::ReadWeights(const NeuralNet &net)
+    {
+        auto offsets = layerOffsets(net.m_NetArchitecture, net.m_Stride);
+        auto weights = vector<double>(offsets.back());
+
+        for (size_t i = 0; i < net.m_NetArchitecture.size(); i++)
+        {
+            std::copy_n(net.m_Weights[i]->Data(), offsets[i + 1] - offsets[i], weights.data() + offsets[i]);
+        }
+
+        return weights;
+    }
+
+    void LbfgsTrainer::WriteWeights(NeuralNet &net, const vector<double> &weights)
+    {
+        auto offsets = layerOffsets(net.m_NetArchitecture, net.m_Stride);
+
+        for (size_t i = 0; i < net.m_NetArchitecture.size(); i++)
+        {
+            std::copy_n(weights.data() + offsets[i], offsets[i + 1] - offsets[i], net.WritableLayer(i));
+        }
+    }
+
+} // End namespace ai_assignment
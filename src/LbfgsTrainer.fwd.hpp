@@ -0,0 +1,12 @@
+#pragma once
+#ifndef FWD_H_530093_SRC_LBFGS_TRAINER
+#define FWD_H_530093_SRC_LBFGS_TRAINER 1
+
+namespace ai_assignment
+{
+    class LbfgsTrainer;
+
+} // End namespace ai_assignment
+
+
+#endif // FWD_H_530093_SRC_LBFGS_TRAINER
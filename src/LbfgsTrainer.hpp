@@ -0,0 +1,153 @@
+#pragma once
+#ifndef H_530093_SRC_LBFGS_TRAINER
+#define H_530093_SRC_LBFGS_TRAINER 1
+
+#include "LbfgsTrainer.fwd.hpp"
+#include "NeuralNet.fwd.hpp"
+
+#include <vector>
+#include <cstddef>
+#include <ostream>
+
+#include "NeuralNet.hpp"
+
+
+namespace ai_assignment
+{
+    /**
+     * @brief Trains a net on the whole example set at once with L-BFGS (Nocedal & Wright, 2006, algorithm 7.5) and a strong Wolfe line search. Each step takes the exact gradient of the mean squared error over every example, including the paths values take when they carry over a layer. Suits nets with up to around 100k weights, where it needs far fewer passes than TrainNetwork
+     */
+    class LbfgsTrainer
+    {
+        public:
+
+            // Definitions
+
+            typedef NeuralNet::Example Example;
+
+            struct Options
+            {
+                /**
+                 * @brief The number of recent steps used to estimate the curvature
+                 */
+                size_t history = 10;
+
+                /**
+                 * @brief Stop after this many epochs (one per step, however many passes its line search took)
+                 */
+                size_t maxEpochs = 1000;
+
+                /**
+                 * @brief Stop once the length of the gradient falls to this
+                 */
+                double gradientTolerance = 1E-8;
+
+                /**
+                 * @brief Stop once a step improves the error by less than this fraction
+                 */
+                double relativeTolerance = 1E-12;
+
+                /**
+                 * @brief The most passes over the examples the line search may make in one step
+                 */
+                size_t maxLineSearch = 20;
+
+                /**
+                 * @brief The most threads to take the gradient with, zero uses them all
+                 */
+                size_t threads = 0;
+
+                /**
+                 * @brief If set, receives "epoch,mse" for every epoch, in the same format as TrainNetwork's err.csv
+                 */
+                std::ostream *errLog = nullptr;
+            };
+
+            enum class Stop
+            {
+                GradientTolerance,
+                RelativeTolerance,
+                MaxEpochs,
+                // The line search couldn't lower the error, normally because it's as low as rounding allows
+                LineSearchFailed
+            };
+
+            struct Result
+            {
+                size_t epochs = 0;
+
+                /**
+                 * @brief The number of passes over the examples, including those made by the line search
+                 */
+                size_t evaluations = 0;
+
+                /**
+                 * @brief The mean squared error of the final weights, the same measure as TrainNetwork's
+                 */
+                double mse = 0.0;
+
+                double gradientNorm = 0.0;
+
+                Stop reason = Stop::MaxEpochs;
+            };
+
+
+            // Constructors
+
+
+            inline LbfgsTrainer()
+                : LbfgsTrainer(Options())
+            {}
+
+            LbfgsTrainer(const Options &options);
+
+            virtual ~LbfgsTrainer() noexcept = default;
+
+            // Functions
+
+            /**
+             * @brief Train the net until one of the tolerances is met, publishing the weights after every epoch. Holds the net's lock throughout, so it's thread safe like TrainNetwork
+             *
+             * @param net The net to train
+             * @param examples The examples to train on
+             */
+            Result Train(NeuralNet &net, const vector<Example> &examples) const;
+
+            /**
+             * @brief The mean squared error of the net over the examples and its gradient with respect to every weight, in the layout of GetParameters. Thread safe
+             */
+            double Gradient(const NeuralNet &net, const vector<Example> &examples, vector<double> &gradient) const;
+
+        protected:
+
+            // Properties
+
+            const Options m_Options;
+
+            // Functions
+
+            /**
+             * @brief The mean squared error and its gradient for a set of weights, laid out like the net's layers: each neuron's row of m_Stride weights, layer by layer
+             *
+             * @param net The net whose architecture and activation functions to use
+             * @param weights The weights, in rows
+             * @param examples The examples to sum the error over
+             * @param gradient Receives the gradient, in rows. Padding is left at zero
+             */
+            double Evaluate(const NeuralNet &net, const vector<double> &weights, const vector<Example> &examples, vector<double> &gradient) const;
+
+            /**
+             * @brief Copy the weights of every layer into rows. The caller must hold the net's lock
+             */
+            static vector<double> ReadWeights(const NeuralNet &net);
+
+            /**
+             * @brief Copy rows of weights into every layer. The caller must hold the net's lock
+             */
+            static void WriteWeights(NeuralNet &net, const vector<double> &weights);
+    };
+
+} // End namespace ai_assignment
+
+
+#endif // H_530093_SRC_LBFGS_TRAINER
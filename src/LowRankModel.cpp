@@ -0,0 +1,448 @@
+#include "LowRankModel.hpp"
+
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <algorithm>
+
+#include "utils.hpp"
+#include "Trace.hpp"
+
+
+namespace ai_assignment
+{
+    namespace
+    {
+        /**
+         * @brief Sweeps of rotations the decomposition may take, it normally converges in well under ten
+         */
+        constexpr size_t MaxSweeps = 60;
+
+        inline double dot(const double *a, const double *b, size_t count)
+        {
+            return std::inner_product(a, a + count, b, 0.0);
+        }
+
+    } // End anonymous namespace
+
+
+    // Public Constructors
+
+
+    LowRankModel::LowRankModel(const NeuralNet &net, const vector<Example> &examples, const Options &options)
+        : m_ActivationFunctions(net.m_ActivationFunctions),
+            m_Inputs(net.m_Inputs),
+            m_Outputs(net.m_NetArchitecture.back())
+    {
+        if (options.mseBudget && examples.empty()) throw std::invalid_argument("Picking ranks by an MSE budget needs examples");
+        if (options.fineTuneEpochs > 0 && examples.empty()) throw std::invalid_argument("Fine-tuning needs examples");
+
+        auto &architecture = net.m_NetArchitecture;
+        size_t layerCount = architecture.size();
+
+        // Each layer's dense weights, without the padding
+        auto weights = vector<vector<double>>(layerCount);
+
+        {
+            auto published = net.PublishedWeights();
+
+            for (size_t i = 0; i < layerCount; i++)
+            {
+                weights[i].resize(architecture[i] * this->m_Inputs);
+
+                for (size_t j = 0; j < architecture[i]; j++)
+                {
+                    std::copy_n(published[i]->Data() + j * net.m_Stride, this->m_Inputs, weights[i].data() + j * this->m_Inputs);
+                }
+            }
+        }
+
+        // Only layers wide enough, and which can save something, are worth decomposing
+        auto candidate = [&](size_t i)
+        {
+            return architecture[i] >= options.minNeurons && LowRankModel::MaxUsefulRank(architecture[i], this->m_Inputs) > 0;
+        };
+
+        auto decompositions = vector<Decomposition>(layerCount);
+
+        this->m_Layers.resize(layerCount);
+
+        for (size_t i = 0; i < layerCount; i++)
+        {
+            trace::Span decomposeSpan("decompose", "compress", i);
+
+            this->m_Layers[i].neurons = architecture[i];
+
+            if (candidate(i)) decompositions[i] = LowRankModel::Decompose(weights[i].data(), architecture[i], this->m_Inputs);
+
+            // Start dense
+            this->SetRank(i, 0, decompositions[i], weights[i].data());
+        }
+
+        if (!examples.empty()) this->m_Report.original = net.Evaluate(examples);
+
+        if (options.mseBudget)
+        {
+            double limit = this->m_Report.original.mse + *options.mseBudget;
+
+            auto withinBudget = [&]() { return this->Evaluate(examples).mse <= limit; };
+
+            for (size_t i = 0; i < layerCount; i++)
+            {
+                if (!candidate(i)) continue;
+
+                trace::Span searchSpan("rank search", "compress", i);
+
+                // The smallest rank within budget, taking the error to rise as the rank falls
+                size_t low = 1;
+                size_t high = LowRankModel::MaxUsefulRank(architecture[i], this->m_Inputs);
+
+                this->SetRank(i, high, decompositions[i], weights[i].data());
+
+                if (!withinBudget())
+                {
+                    this->SetRank(i, 0, decompositions[i], weights[i].data());
+                    continue;
+                }
+
+                while (low < high)
+                {
+                    size_t middle = (low + high) / 2;
+
+                    this->SetRank(i, middle, decompositions[i], weights[i].data());
+
+                    if (withinBudget()) high = middle;
+                    else low = middle + 1;
+                }
+
+                this->SetRank(i, high, decompositions[i], weights[i].data());
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < layerCount; i++)
+            {
+                if (!candidate(i)) continue;
+
+                auto &values = decompositions[i].values;
+                double total = 0.0;
+
+                for (double value : values) total += value * value;
+
+                // The fewest values holding the energy asked for
+                size_t rank = 0;
+                double kept = 0.0;
+
+                while (rank < values.size() && kept < options.energy * total)
+                {
+                    kept += values[rank] * values[rank];
+                    rank++;
+                }
+
+                this->SetRank(i, std::max<size_t>(1, rank), decompositions[i], weights[i].data());
+            }
+        }
+
+        if (options.fineTuneEpochs > 0)
+        {
+            trace::Span fineTuneSpan("fine-tune", "compress");
+
+            // Train a copy of the net, which shares the original's weights until it first writes to them
+            auto copy = NeuralNet(net);
+            auto trainingExamples = examples;
+            double mse = this->Evaluate(examples).mse;
+
+            for (size_t epoch = 0; epoch < options.fineTuneEpochs; epoch++)
+            {
+                // Start from what the model does now
+                auto parameters = vector<double>();
+                parameters.reserve(copy.ParameterCount());
+
+                for (auto &layer : this->m_Layers)
+                {
+                    if (!layer.factored)
+                    {
+                        parameters.insert(parameters.end(), layer.a.begin(), layer.a.end());
+                        continue;
+                    }
+
+                    for (size_t j = 0; j < layer.neurons; j++)
+                    {
+                        for (size_t k = 0; k < this->m_Inputs; k++)
+                        {
+                            double weight = 0.0;
+
+                            for (size_t r = 0; r < layer.rank; r++) weight += layer.a[j * layer.rank + r] * layer.b[r * this->m_Inputs + k];
+
+                            parameters.push_back(weight);
+                        }
+                    }
+                }
+
+                copy.SetParameters(parameters);
+                copy.TrainEpoch(trainingExamples, options.learningRate);
+                parameters = copy.GetParameters();
+
+                // Truncate the trained layers back to their ranks
+                auto previousLayers = this->m_Layers;
+                auto tunedWeights = weights;
+                auto tunedDecompositions = decompositions;
+                const double *next = parameters.data();
+
+                for (size_t i = 0; i < layerCount; i++)
+                {
+                    std::copy_n(next, tunedWeights[i].size(), tunedWeights[i].data());
+                    next += tunedWeights[i].size();
+
+                    size_t rank = this->m_Layers[i].factored? this->m_Layers[i].rank : 0;
+
+                    if (rank > 0) tunedDecompositions[i] = LowRankModel::Decompose(tunedWeights[i].data(), architecture[i], this->m_Inputs);
+
+                    this->SetRank(i, rank, tunedDecompositions[i], tunedWeights[i].data());
+                }
+
+                double tunedMse = this->Evaluate(examples).mse;
+
+                // Stop on an epoch which makes things worse, like TrainNetwork
+                if (tunedMse > mse)
+                {
+                    this->m_Layers = std::move(previousLayers);
+                    break;
+                }
+
+                mse = tunedMse;
+                weights = std::move(tunedWeights);
+                decompositions = std::move(tunedDecompositions);
+
+                this->m_Report.fineTuneEpochs++;
+            }
+        }
+
+        // Sum up what we did
+        for (size_t i = 0; i < layerCount; i++)
+        {
+            auto &layer = this->m_Layers[i];
+            auto &report = this->m_Report.layers.emplace_back();
+
+            report.neurons = layer.neurons;
+            report.inputs = this->m_Inputs;
+            report.factored = layer.factored;
+            report.rank = layer.factored? layer.rank : std::min(layer.neurons, this->m_Inputs);
+            report.denseParameters = layer.neurons * this->m_Inputs;
+            report.parameters = layer.a.size() + layer.b.size();
+            report.denseFlops = 2 * report.denseParameters;
+            report.flops = 2 * report.parameters;
+
+            if (layer.factored)
+            {
+                auto &values = decompositions[i].values;
+                double total = 0.0;
+                double kept = 0.0;
+
+                for (size_t r = 0; r < values.size(); r++)
+                {
+                    total += values[r] * values[r];
+
+                    if (r < layer.rank) kept += values[r] * values[r];
+                }
+
+                report.energy = (total > 0.0)? kept / total : 1.0;
+            }
+
+            this->m_Report.parameters += report.parameters;
+            this->m_Report.denseParameters += report.denseParameters;
+            this->m_Report.flops += report.flops;
+            this->m_Report.denseFlops += report.denseFlops;
+        }
+
+        if (!examples.empty()) this->m_Report.compressed = this->Evaluate(examples);
+    }
+
+
+    // Public Functions
+
+
+    vector<double> *LowRankModel::ProcessInputs(const vector<double> &inputs) const
+    {
+        if (inputs.size() != this->m_Inputs) throw std::invalid_argument("Input provided doesn't match architecture");
+
+        static thread_local vector<double> scratch;
+
+        scratch.resize(3 * this->m_Inputs);
+
+        const double *outputs = this->Forward(inputs.data(), scratch.data());
+
+        return new vector<double>(outputs, outputs + this->m_Outputs);
+    }
+
+    NeuralNet::Evaluation LowRankModel::Evaluate(const vector<Example> &examples, size_t threads) const
+    {
+        return NeuralNet::EvaluateShards(examples, this->m_Inputs, this->m_Outputs, threads, [&](size_t begin, size_t end, auto &&emit)
+        {
+            auto buffer = vector<double>(3 * this->m_Inputs);
+
+            for (size_t e = begin; e < end; e++) emit(e, this->Forward(examples[e].inputs.data(), buffer.data()));
+        });
+    }
+
+
+    // Protected Functions
+
+
+    const double *LowRankModel::Forward(const double *inputs, double *buffer) const
+    {
+        double *layerInputs = buffer;
+        double *outputs = buffer + this->m_Inputs;
+        // The inputs projected onto the kept singular vectors, never longer than the inputs since the rank can't be
+        double *projected = buffer + 2 * this->m_Inputs;
+
+        std::copy_n(inputs, this->m_Inputs, layerInputs);
+
+        for (size_t i = 0; i < this->m_Layers.size(); i++)
+        {
+            auto &layer = this->m_Layers[i];
+            auto &activationFunction = this->m_ActivationFunctions[i];
+
+            // Values carry over to the next layer until a neuron overwrites them
+            std::copy_n(layerInputs, this->m_Inputs, outputs);
+
+            if (layer.factored)
+            {
+                // The first thin product, B x
+                for (size_t r = 0; r < layer.rank; r++) projected[r] = dot(layer.b.data() + r * this->m_Inputs, layerInputs, this->m_Inputs);
+
+                // Then A (B x)
+                for (size_t j = 0; j < layer.neurons; j++) outputs[j] = activationFunction(dot(layer.a.data() + j * layer.rank, projected, layer.rank));
+            }
+            else
+            {
+                for (size_t j = 0; j < layer.neurons; j++) outputs[j] = activationFunction(dot(layer.a.data() + j * this->m_Inputs, layerInputs, this->m_Inputs));
+            }
+
+            std::swap(layerInputs, outputs);
+        }
+
+        return layerInputs;
+    }
+
+    void LowRankModel::SetRank(size_t i, size_t rank, const Decomposition &decomposition, const double *weights)
+    {
+        auto &layer = this->m_Layers[i];
+
+        layer.factored = rank > 0 && rank <= LowRankModel::MaxUsefulRank(layer.neurons, this->m_Inputs) && rank <= decomposition.values.size();
+
+        if (!layer.factored)
+        {
+            layer.rank = 0;
+            layer.a.assign(weights, weights + layer.neurons * this->m_Inputs);
+            layer.b.clear();
+
+            return;
+        }
+
+        layer.rank = rank;
+        layer.a.resize(layer.neurons * rank);
+        layer.b.assign(decomposition.right.begin(), decomposition.right.begin() + rank * this->m_Inputs);
+
+        // Fold the singular values into A
+        for (size_t j = 0; j < layer.neurons; j++)
+        {
+            for (size_t r = 0; r < rank; r++) layer.a[j * rank + r] = decomposition.left[j * layer.neurons + r] * decomposition.values[r];
+        }
+    }
+
+    LowRankModel::Decomposition LowRankModel::Decompose(const double *weights, size_t neurons, size_t inputs)
+    {
+        // Rotate pairs of rows of W until they're all orthogonal, accumulating the rotations in V. The rows then hold Σ Uᵀ
+        auto rows = vector<double>(weights, weights + neurons * inputs);
+        auto rotations = vector<double>(neurons * neurons);
+
+        for (size_t j = 0; j < neurons; j++) rotations[j * neurons + j] = 1.0;
+
+        for (size_t sweep = 0; sweep < MaxSweeps; sweep++)
+        {
+            bool rotated = false;
+
+            for (size_t p = 0; p + 1 < neurons; p++)
+            {
+                for (size_t q = p + 1; q < neurons; q++)
+                {
+                    double *rowP = rows.data() + p * inputs;
+                    double *rowQ = rows.data() + q * inputs;
+
+                    double alpha = dot(rowP, rowP, inputs);
+                    double beta = dot(rowQ, rowQ, inputs);
+                    double gamma = dot(rowP, rowQ, inputs);
+
+                    if (std::abs(gamma) <= std::numeric_limits<double>::epsilon() * std::sqrt(alpha * beta)) continue;
+
+                    rotated = true;
+
+                    // The rotation which makes the pair orthogonal
+                    double zeta = (beta - alpha) / (2.0 * gamma);
+                    double t = std::copysign(1.0, zeta) / (std::abs(zeta) + std::sqrt(1.0 + zeta * zeta));
+                    double c = 1.0 / std::sqrt(1.0 + t * t);
+                    double s = c * t;
+
+                    for (size_t k = 0; k < inputs; k++)
+                    {
+                        double valueP = rowP[k];
+                        double valueQ = rowQ[k];
+
+                        rowP[k] = c * valueP - s * valueQ;
+                        rowQ[k] = s * valueP + c * valueQ;
+                    }
+
+                    for (size_t j = 0; j < neurons; j++)
+                    {
+                        double valueP = rotations[j * neurons + p];
+                        double valueQ = rotations[j * neurons + q];
+
+                        rotations[j * neurons + p] = c * valueP - s * valueQ;
+                        rotations[j * neurons + q] = s * valueP + c * valueQ;
+                    }
+                }
+            }
+
+            if (!rotated) break;
+        }
+
+        // The singular values are the lengths of the rows, largest first
+        auto lengths = vector<double>(neurons);
+        auto order = vector<size_t>(neurons);
+
+        for (size_t p = 0; p < neurons; p++) lengths[p] = std::sqrt(dot(rows.data() + p * inputs, rows.data() + p * inputs, inputs));
+
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return lengths[a] > lengths[b]; });
+
+        auto decomposition = Decomposition();
+        decomposition.values.resize(neurons);
+        decomposition.left.resize(neurons * neurons);
+        decomposition.right.resize(neurons * inputs);
+
+        for (size_t r = 0; r < neurons; r++)
+        {
+            size_t p = order[r];
+            double length = lengths[p];
+
+            decomposition.values[r] = length;
+
+            for (size_t j = 0; j < neurons; j++) decomposition.left[j * neurons + r] = rotations[j * neurons + p];
+
+            for (size_t k = 0; k < inputs; k++) decomposition.right[r * inputs + k] = (length > 0.0)? rows[p * inputs + k] / length : 0.0;
+        }
+
+        return decomposition;
+    }
+
+    size_t LowRankModel::MaxUsefulRank(size_t neurons, size_t inputs) noexcept
+    {
+        // Factoring costs rank ⨉ (neurons + inputs) against neurons ⨉ inputs
+        if (neurons == 0 || inputs == 0) return 0;
+
+        return (neurons * inputs - 1) / (neurons + inputs);
+    }
+
+} // End namespace ai_assignment
@@ -0,0 +1,12 @@
+#pragma once
+#ifndef FWD_H_530093_SRC_LOW_RANK_MODEL
+#define FWD_H_530093_SRC_LOW_RANK_MODEL 1
+
+namespace ai_assignment
+{
+    class LowRankModel;
+
+} // End namespace ai_assignment
+
+
+#endif // FWD_H_530093_SRC_LOW_RANK_MODEL
@@ -0,0 +1,239 @@
+#pragma once
+#ifndef H_530093_SRC_LOW_RANK_MODEL
+#define H_530093_SRC_LOW_RANK_MODEL 1
+
+#include "LowRankModel.fwd.hpp"
+#include "NeuralNet.fwd.hpp"
+
+#include <vector>
+#include <cstddef>
+#include <optional>
+
+#include "NeuralNet.hpp"
+
+
+namespace ai_assignment
+{
+    /**
+     * @brief A compressed copy of a trained net for inference. Each wide layer's weights W (neurons ⨉ inputs) are replaced by the truncated singular value decomposition A B, with A neurons ⨉ rank and B rank ⨉ inputs, so the layer costs two thin products rather than one wide one. Thread safe once constructed
+     */
+    class LowRankModel
+    {
+        public:
+
+            // Definitions
+
+            typedef NeuralNet::Example Example;
+
+            struct Options
+            {
+                /**
+                 * @brief Keep the fewest singular values of each layer holding this fraction of the sum of their squares
+                 */
+                double energy = 0.99;
+
+                /**
+                 * @brief If set, ranks are instead picked to keep the rise in mean squared error on the examples within this. Layers are compressed in order, each as far as what's left of the budget allows
+                 */
+                std::optional<double> mseBudget;
+
+                /**
+                 * @brief Leave layers with fewer neurons than this dense, there's too little to gain
+                 */
+                size_t minNeurons = 8;
+
+                /**
+                 * @brief The number of epochs of TrainNetwork to recover accuracy with, after which each layer is truncated back to its rank. Stops early on an epoch which makes the error worse
+                 */
+                size_t fineTuneEpochs = 0;
+
+                double learningRate = 0.1;
+            };
+
+            struct LayerReport
+            {
+                size_t neurons = 0;
+                size_t inputs = 0;
+
+                /**
+                 * @brief The rank kept, or the full rank if the layer was left dense
+                 */
+                size_t rank = 0;
+
+                bool factored = false;
+
+                /**
+                 * @brief The fraction of the sum of the squared singular values kept
+                 */
+                double energy = 1.0;
+
+                size_t parameters = 0;
+                size_t denseParameters = 0;
+
+                /**
+                 * @brief Floating point operations per input, counting a multiply-add as two
+                 */
+                size_t flops = 0;
+                size_t denseFlops = 0;
+            };
+
+            struct Report
+            {
+                vector<LayerReport> layers;
+
+                size_t parameters = 0;
+                size_t denseParameters = 0;
+
+                size_t flops = 0;
+                size_t denseFlops = 0;
+
+                /**
+                 * @brief The original net on the examples, left empty if there were none
+                 */
+                NeuralNet::Evaluation original;
+
+                /**
+                 * @brief The compressed model on the examples, after any fine-tuning
+                 */
+                NeuralNet::Evaluation compressed;
+
+                size_t fineTuneEpochs = 0;
+            };
+
+
+            // Constructors
+
+
+            /**
+             * @brief Compress a net, picking each layer's rank by the energy it keeps
+             *
+             * @param net The net to compress, its published weights are used and it's left untouched
+             * @param options How far to compress
+             */
+            inline LowRankModel(const NeuralNet &net, const Options &options)
+                : LowRankModel(net, vector<Example>(), options)
+            {}
+
+            inline LowRankModel(const NeuralNet &net)
+                : LowRankModel(net, Options())
+            {}
+
+            /**
+             * @brief Compress a net, measuring the accuracy on a set of examples. Needed to pick ranks by an MSE budget, or to fine-tune
+             *
+             * @param net The net to compress, its published weights are used and it's left untouched. Fine-tuning trains a copy of it
+             * @param examples The examples to measure the accuracy on, and to fine-tune with
+             * @param options How far to compress
+             */
+            LowRankModel(const NeuralNet &net, const vector<Example> &examples, const Options &options);
+
+            inline virtual ~LowRankModel() noexcept
+            {}
+
+            // Accessors
+
+            /**
+             * @brief What was compressed, and how much it cost in accuracy
+             */
+            inline const Report &GetReport() const noexcept
+            {
+                return this->m_Report;
+            }
+
+            // Functions
+
+            /**
+             * @brief Runs the inputs through the model and returns the outputs. Thread safe
+             *
+             * @param inputs The inputs, including the bias/threshold
+             * @return vector<double>* The outputs, on the heap for the caller to delete
+             */
+            vector<double> *ProcessInputs(const vector<double> &inputs) const;
+
+            /**
+             * @brief Measures the model on a set of examples, in the same way as NeuralNet::Evaluate. Thread safe
+             */
+            NeuralNet::Evaluation Evaluate(const vector<Example> &examples, size_t threads = 0) const;
+
+        protected:
+
+            // Definitions
+
+            struct Layer
+            {
+                size_t neurons = 0;
+                size_t rank = 0;
+                bool factored = false;
+
+                /**
+                 * @brief neurons ⨉ rank when factored, otherwise the dense weights, neurons ⨉ inputs
+                 */
+                vector<double> a;
+
+                /**
+                 * @brief rank ⨉ inputs when factored, otherwise empty
+                 */
+                vector<double> b;
+            };
+
+            /**
+             * @brief A layer's singular value decomposition W = V Σ Uᵀ, sorted by singular value
+             */
+            struct Decomposition
+            {
+                vector<double> values;
+
+                /**
+                 * @brief The left singular vectors, neurons ⨉ neurons, one column per singular value
+                 */
+                vector<double> left;
+
+                /**
+                 * @brief The right singular vectors, one row of inputs values per singular value
+                 */
+                vector<double> right;
+            };
+
+            // Properties
+
+            vector<Layer> m_Layers;
+
+            vector< Neuron::activation_func_type > m_ActivationFunctions;
+
+            const size_t m_Inputs;
+
+            const size_t m_Outputs;
+
+            Report m_Report;
+
+            // Functions
+
+            /**
+             * @brief Propagates the inputs through the model, with the same carry-over as NeuralNet
+             *
+             * @param inputs m_Inputs values
+             * @param buffer Space for 2 ⨉ m_Inputs values, followed by the widest rank
+             * @return const double* The outputs of the final layer, inside buffer
+             */
+            const double *Forward(const double *inputs, double *buffer) const;
+
+            /**
+             * @brief Sets layer i to a rank of its decomposition, or to the dense weights if the rank doesn't save anything
+             */
+            void SetRank(size_t i, size_t rank, const Decomposition &decomposition, const double *weights);
+
+            /**
+             * @brief The decomposition of a neurons ⨉ inputs matrix, by one-sided Jacobi rotations (Hestenes, 1958)
+             */
+            static Decomposition Decompose(const double *weights, size_t neurons, size_t inputs);
+
+            /**
+             * @brief The largest rank at which factoring a layer still saves work
+             */
+            static size_t MaxUsefulRank(size_t neurons, size_t inputs) noexcept;
+    };
+
+} // End namespace ai_assignment
+
+
+#endif // H_530093_SRC_LOW_RANK_MODEL
@@ -4,107 +4,138 @@
 namespace ai_assignment
 {
     // Public Constructors
-    
+
     NeuralNet::NeuralNet(
                 const vector<size_t> netArchitecture,
                 const size_t inputs,
                 const vector< Neuron::activation_func_type > activationFunctions,
-                vector< vector < vector< double >* > > *startingWeights
+                vector< vector < vector< double >* > > *startingWeights,
+                const Arena::Options &arenaOptions,
+                const Initialiser &initialiser
             )
-        : m_NetArchitecture(netArchitecture), m_Inputs(inputs)
+        : m_NetArchitecture(netArchitecture), m_Inputs(inputs),
+            m_Stride(Arena::AlignedCount<double>(inputs)),
+            m_Arena(std::make_shared<Arena>(NeuralNet::SizeArena(netArchitecture, inputs, arenaOptions)))
     {
-        this->InitialiseNeurons(netArchitecture, inputs, activationFunctions, startingWeights);
+        this->AllocateLayers(activationFunctions);
+        this->InitialiseLayers(startingWeights, initialiser);
+        this->TuneKernels();
+        this->PublishWeights();
 
         // Dispose of the starting weights collection, we don't need the collection any more
         if (startingWeights != nullptr) delete startingWeights;
     }
 
-    NeuralNet::NeuralNet(const NeuralNet &obj) noexcept
-        : m_Architecture(obj.m_Architecture),
-            m_NetArchitecture(obj.m_NetArchitecture),
-            m_Inputs(obj.m_Inputs)
+    NeuralNet::NeuralNet(const NeuralNet &obj)
+        : m_NetArchitecture(obj.m_NetArchitecture),
+            m_Inputs(obj.m_Inputs),
+            m_Stride(obj.m_Stride),
+            // Size the region to fit every layer we might write to, so copies of shared layers don't each map their own. Pages are only touched as layers are copied
+            m_Arena(std::make_shared<Arena>(NeuralNet::SizeArena(obj.m_NetArchitecture, obj.m_Inputs, obj.m_Arena->GetOptions()))),
+            m_LayerKernels(obj.m_LayerKernels),
+            m_BatchKernels(obj.m_BatchKernels)
     {
-        // Create new values on the heap
-        
-        // Create a new value on the heap for each neuron
-        for (size_t i = 0; i < this->m_Architecture.size(); i++)
-        {
-            for (size_t j = 0; j < this->m_Architecture.at(i).size(); j++)
-            {
-                this->m_Architecture.at(i).at(j) = new auto(*this->m_Architecture.at(i).at(j));
-            }
-        }
+        auto scopedLock = std::scoped_lock(obj.m_Lock);
+
+        // Share every layer's weights, they're copied into our arena when first written to
+        this->m_Weights = obj.m_Weights;
+        this->m_ActivationFunctions = obj.m_ActivationFunctions;
+
+        this->AllocateScratch();
+        this->PublishWeights();
     }
 
 
     // Public Functions
 
-    
+
     vector<double> *NeuralNet::ProcessInputs(vector<double> inputs, vector<vector<double>> *recordedOutputs)
     {
-        // Lock the mutex and release on destruction (return)
-        auto scopedLock = std::scoped_lock(this->m_Lock);
-        
         // Check the input is valid
-        size_t inputCount = inputs.size();
-        
-        if (inputCount != this->m_Inputs) throw std::invalid_argument("Input provided doesn't match architecture");
-        
-        // Create a copy of the inputs to store outputs in
-        // The copy is neccicary so that we keep the very last value (bias/threshold)
-        size_t layerCount = this->m_NetArchitecture.size();
+        if (inputs.size() != this->m_Inputs) throw std::invalid_argument("Input provided doesn't match architecture");
 
-        vector<double> outputs = vector<double>(inputs);
-        vector<double> *finalOutputs = new vector<double>(
-            this->m_NetArchitecture.at(layerCount - 1)
-        );
+        // Hold on to the last published weights, so training can carry on (writing to its own copy of each layer) while we run
+        trace::Span lockSpan("lock", "sync");
+        auto weights = this->PublishedWeights();
+        lockSpan.End();
 
-        // Execute the neurons layer-by-layer
-        for (size_t i = 0; i < layerCount; i++)
+        double *activations = this->InferenceScratch();
+        const double *outputs = this->Forward(weights, inputs.data(), activations);
+
+        // Record the outputs if it wants us to
+        if (recordedOutputs != nullptr)
         {
-            for (size_t j = 0; j < this->m_NetArchitecture.at(i); j++)
+            for (size_t i = 0; i < weights.size(); i++)
             {
-                // Use the output of the previous layer to input into each neuron on this layer
+                const double *layerOutputs = activations + i * this->m_Stride;
 
-                // If this is the last layer, fill out the final outputs
-                if (i + 1 == layerCount)
-                {
-                    finalOutputs->at(j) = this->m_Architecture.at(i).at(j)->ProcessInputs(inputs);
-                }
-                // Otherwise, fill in the outputs for the next layer
-                else
-                {
-                    outputs.at(j) = this->m_Architecture.at(i).at(j)->ProcessInputs(inputs);
-                }
+                recordedOutputs->at(i) = vector<double>(layerOutputs, layerOutputs + this->m_Inputs);
             }
+        }
 
-            // Copy the outputs of this layer to use as the inputs of the next layer
-            inputs = outputs;
+        return new vector<double>(outputs, outputs + this->m_NetArchitecture.back());
+    }
 
-            // Record the outputs if it wants us to
-            if (recordedOutputs != nullptr) recordedOutputs->at(i) = outputs;
-        }
+    vector<double> *NeuralNet::ProcessInputs(const SparseVector &inputs)
+    {
+        if (inputs.dimension != this->m_Inputs) throw std::invalid_argument("Input provided doesn't match architecture");
+
+        inputs.Validate();
+
+        trace::Span lockSpan("lock", "sync");
+        auto weights = this->PublishedWeights();
+        lockSpan.End();
+
+        double *activations = this->InferenceScratch();
+        const double *outputs = this->ForwardSparse(weights, inputs, activations);
+
+        return new vector<double>(outputs, outputs + this->m_NetArchitecture.back());
+    }
+
+    NeuralNet::Evaluation NeuralNet::Evaluate(const vector<Example> &examples, size_t threads) const
+    {
+        // Stick with one set of weights for the whole evaluation
+        auto weights = this->PublishedWeights();
+
+        return NeuralNet::EvaluateShards(examples, this->m_Inputs, this->m_NetArchitecture.back(), threads, [&](size_t begin, size_t end, auto &&emit)
+        {
+            // Pad each example's inputs out to a whole row
+            auto inputs = vector<double>(ForwardBatchSize * this->m_Stride);
+            auto buffer = vector<double>(2 * ForwardBatchSize * this->m_Stride);
 
-        return finalOutputs;
+            for (size_t batchStart = begin; batchStart < end; batchStart += ForwardBatchSize)
+            {
+                size_t count = std::min(ForwardBatchSize, end - batchStart);
+
+                for (size_t b = 0; b < count; b++)
+                {
+                    std::copy_n(examples[batchStart + b].inputs.data(), this->m_Inputs, inputs.data() + b * this->m_Stride);
+                }
+
+                const double *outputs = this->ForwardBatch(weights, inputs.data(), count, buffer.data());
+
+                for (size_t b = 0; b < count; b++) emit(batchStart + b, outputs + b * this->m_Stride);
+            }
+        });
     }
 
     size_t NeuralNet::TrainNetwork(vector<Example> &trainingExamples, double learningRate)
     {
         // Acquire lock
+        trace::Span lockSpan("lock", "sync");
         auto scopedLock = std::scoped_lock(this->m_Lock);
+        lockSpan.End();
 
         // Setthe first mean squared error to an arbitrarily large value to avoid thinking that it's getting worse on the first iteration
         double mse = 1E300;
         double previousMSE;
         size_t epochs = 0;
 
-        // Setup the storage for the results
-        auto *outputCache = new vector<vector<double>>(this->m_NetArchitecture.size());
-        // Cache the current weights to go back if we're not improving the situation
-        auto *prevWeights = this->GetWeights();
-        // And run the same method to give us a properly initialised object to store new weights in
-        auto *newWeights = this->GetWeights();
-        
+        // Share the current weights to go back to if we're not improving the situation
+        // Committing and reverting only swap pointers, but the first update of each epoch still copies every layer out of the committed set, so each epoch copies all the weights once
+        // Between the two we only ever hold two buffers per layer
+        auto committedWeights = this->ShareWeights();
+
         // Places to write to for the assignment
         // File writing code snippet taken from https://en.cppreference.com/w/cpp/io/manip/setprecision
         std::fstream errCsv;
@@ -118,35 +149,32 @@ namespace ai_assignment
         // Loop until break
         while (true)
         {
+            trace::Span epochSpan("epoch", "train", epochs + 1);
+
             // Print the weights to the output file (very slow)
+            trace::Span loggingSpan("logging", "train");
             this->PrintWeights(weightsCsv);
-            
+            loggingSpan.End();
+
             // Copy the last mse to be the previous one
             previousMSE = mse;
-            mse = 0.0;
             epochs++;
-            
-            for (size_t i = 0; i < outputCache->size(); i++)
-            {
-                outputCache->at(i) = vector<double>(this->m_Inputs);
-            }
-            
-            for (size_t i = 0; i < trainingExamples.size(); i++)
-            {
-                mse += this->TrainNetwork(trainingExamples[i], learningRate, outputCache, newWeights);
-            }
 
-            mse /= trainingExamples.size();
+            // Keeps the epoch (letting the old weights go back to the arena) and publishes it, or flips back to the previous weights if it made things worse
+            auto rejectedWeights = weight_set_type();
+            auto outcome = this->RunCheckedEpoch(trainingExamples, learningRate, committedWeights, previousMSE, true, mse, nullptr, &rejectedWeights);
 
+            trace::Span errLoggingSpan("logging", "train");
             errCsv << epochs << ',' << mse << std::endl;
+            errLoggingSpan.End();
 
-            // If this epoch has made things worse, revert that epoch and end the training
-            if (mse > previousMSE)
+            // If this epoch has made things worse, it's been reverted and the training ends
+            if (outcome == EpochOutcome::Worse)
             {
+                trace::Span revertSpan("logging", "train");
+
                 // Log the weights from this epoch
-                this->PrintWeights(weightsCsv);
-                // Update to the previous weights
-                this->SetWeights(prevWeights);
+                this->PrintWeights(weightsCsv, rejectedWeights);
                 // Log the final weights
                 // But label that data
                 weightsCsv << "# Revert update ↓" << std::endl;
@@ -160,37 +188,297 @@ namespace ai_assignment
 
             // Otherwise, continue in a loop until the mean squared error stops changing
             if (mse == previousMSE) break;
-
-            // Copy the new weights into the previous weights so we can revert to them if the training went badly
-            *prevWeights = *newWeights;
         }
 
         // Cleanup
         errCsv.close();
         weightsCsv.close();
-        delete outputCache;
-        delete prevWeights;
-        delete newWeights;
 
         return epochs;
     }
 
-    double NeuralNet::TrainNetwork(Example &trainingExample, double &learningRate, vector<vector<double>> *sharedOutputCache, weight_type *newWeights)
+    double NeuralNet::TrainEpoch(vector<Example> &trainingExamples, double learningRate)
+    {
+        trace::Span lockSpan("lock", "sync");
+        auto scopedLock = std::scoped_lock(this->m_Lock);
+        lockSpan.End();
+
+        double mse = this->RunEpoch(trainingExamples, learningRate);
+
+        this->PublishWeights();
+
+        return mse;
+    }
+
+    vector<double> NeuralNet::GetParameters() const
+    {
+        auto scopedLock = std::scoped_lock(this->m_Lock);
+
+        auto parameters = vector<double>();
+        parameters.reserve(this->ParameterCount());
+
+        for (size_t i = 0; i < this->m_Weights.size(); i++)
+        {
+            for (size_t j = 0; j < this->m_NetArchitecture[i]; j++)
+            {
+                const double *row = this->Row(i, j);
+
+                parameters.insert(parameters.end(), row, row + this->m_Inputs);
+            }
+        }
+
+        return parameters;
+    }
+
+    void NeuralNet::SetParameters(const vector<double> &parameters)
     {
+        if (parameters.size() != this->ParameterCount()) throw std::invalid_argument("Parameters don't match architecture");
+
+        auto scopedLock = std::scoped_lock(this->m_Lock);
+
+        const double *next = parameters.data();
+
+        for (size_t i = 0; i < this->m_Weights.size(); i++)
+        {
+            double *layerWeights = this->WritableLayer(i);
+
+            for (size_t j = 0; j < this->m_NetArchitecture[i]; j++)
+            {
+                std::copy_n(next, this->m_Inputs, layerWeights + j * this->m_Stride);
+                next += this->m_Inputs;
+            }
+        }
+
+        this->PublishWeights();
+    }
+
+    double NeuralNet::TrainNetwork(Example &trainingExample, double &learningRate)
+    {
+        if (trainingExample.inputs.size() != this->m_Inputs) throw std::invalid_argument("Input provided doesn't match architecture");
+
         // Propagate the input forward through the network
-        auto out = this->ProcessInputs(trainingExample.inputs, sharedOutputCache);
+        // We call the unlocked version since the caller already holds the lock
+        const double *inputs = trainingExample.inputs.data();
+        trace::Span forwardSpan("forward", "train");
+        const double *out = this->Forward(this->m_Weights, inputs, this->m_Activations);
+        forwardSpan.End();
+
+        // Get the mean variance from the example to return
+        double returnErr = this->Backpropagate(trainingExample.targetOutput.data(), out);
+
+        size_t layerCount = this->m_NetArchitecture.size();
+
+        // Then update the network weights
+        trace::Span updateSpan("update", "train");
+
+        // Every layer
+        for (size_t i = 0; i < layerCount; i++)
+        {
+            const double *errorTerms = this->m_ErrorTerms + i * this->m_Stride;
+            // To get Δw we need the inputs to this neuron, which could be from another neuron or the example
+            const double *layerInputs = (i == 0)? inputs : this->m_Activations + (i - 1) * this->m_Stride;
+
+            // Take our own copy of the layer if it's still shared with the net we were cloned from
+            double *layerWeights = this->WritableLayer(i);
+
+            // Every neuron
+            for (size_t j = 0; j < this->m_NetArchitecture[i]; j++)
+            {
+                double *weights = layerWeights + j * this->m_Stride;
+
+                // The weights in that neuron
+                for (size_t k = 0; k < this->m_Inputs; k++)
+                {
+                    // T4.5
+                    weights[k] += learningRate * ( errorTerms[j] * layerInputs[k] );
+                }
+            }
+        }
+
+        // Return the figure generated earlier as the square error (t - o)
+        // We squared it earlier, which also means we have the absolute value
+        return returnErr;
+    }
+
+    double NeuralNet::TrainNetwork(Example &trainingExample, double &learningRate, vector<vector<double>> *sharedOutputCache, weight_type *newWeights)
+    {
+        double returnErr = this->TrainNetwork(trainingExample, learningRate);
+
+        for (size_t i = 0; i < this->m_NetArchitecture.size(); i++)
+        {
+            // The forward pass left each layer's outputs in m_Activations
+            if (sharedOutputCache != nullptr)
+            {
+                const double *layerOutputs = this->m_Activations + i * this->m_Stride;
+
+                sharedOutputCache->at(i) = vector<double>(layerOutputs, layerOutputs + this->m_Inputs);
+            }
+
+            if (newWeights == nullptr) continue;
+
+            for (size_t j = 0; j < this->m_NetArchitecture[i]; j++)
+            {
+                const double *row = this->Row(i, j);
+
+                for (size_t k = 0; k < this->m_Inputs; k++) newWeights->at(i).at(j).at(k) = row[k];
+            }
+        }
+
+        return returnErr;
+    }
+
+    double NeuralNet::TrainNetwork(SparseExample &trainingExample, double &learningRate)
+    {
+        auto &inputs = trainingExample.inputs;
+
+        if (inputs.dimension != this->m_Inputs) throw std::invalid_argument("Input provided doesn't match architecture");
+        if (trainingExample.targetOutput.size() != this->m_NetArchitecture.back()) throw std::invalid_argument("Target output doesn't match architecture");
+
+        inputs.Validate();
+
+        trace::Span forwardSpan("forward", "train");
+        const double *out = this->ForwardSparse(this->m_Weights, inputs, this->m_Activations);
+        forwardSpan.End();
+
+        // The error terms only depend on the outputs of each layer, which are all dense
+        double returnErr = this->Backpropagate(trainingExample.targetOutput.data(), out);
+
+        trace::Span updateSpan("update", "train");
+
+        size_t layerCount = this->m_NetArchitecture.size();
+        size_t prefix = 0;
+
+        for (size_t i = 0; i < layerCount; i++)
+        {
+            const double *errorTerms = this->m_ErrorTerms + i * this->m_Stride;
+            const double *previousOutputs = (i == 0)? nullptr : this->m_Activations + (i - 1) * this->m_Stride;
+
+            // The zero inputs would leave their weights alone, so only touch the dense prefix and the sparse inputs past it
+            size_t first = std::lower_bound(inputs.indices.begin(), inputs.indices.end(), prefix) - inputs.indices.begin();
+
+            double *layerWeights = this->WritableLayer(i);
+
+            for (size_t j = 0; j < this->m_NetArchitecture[i]; j++)
+            {
+                double *weights = layerWeights + j * this->m_Stride;
+
+                for (size_t k = 0; k < prefix; k++)
+                {
+                    weights[k] += learningRate * ( errorTerms[j] * previousOutputs[k] );
+                }
+
+                for (size_t n = first; n < inputs.indices.size(); n++)
+                {
+                    weights[inputs.indices[n]] += learningRate * ( errorTerms[j] * inputs.values[n] );
+                }
+            }
+
+            prefix = std::max(prefix, this->m_NetArchitecture[i]);
+        }
+
+        return returnErr;
+    }
 
-        // Create a place to store error terms for the neurons
+    double NeuralNet::TrainEpoch(vector<SparseExample> &trainingExamples, double learningRate)
+    {
+        trace::Span lockSpan("lock", "sync");
+        auto scopedLock = std::scoped_lock(this->m_Lock);
+        lockSpan.End();
+
+        double mse = 0.0;
+
+        for (size_t i = 0; i < trainingExamples.size(); i++)
+        {
+            trace::Span exampleSpan("example", "train", i);
+            mse += this->TrainNetwork(trainingExamples[i], learningRate);
+        }
+
+        this->PublishWeights();
+
+        return mse / trainingExamples.size();
+    }
+
+
+    // Protected Functions
+
+
+    double NeuralNet::RunEpoch(vector<Example> &trainingExamples, double &learningRate)
+    {
+        double mse = 0.0;
+
+        for (size_t i = 0; i < trainingExamples.size(); i++)
+        {
+            trace::Span exampleSpan("example", "train", i);
+            mse += this->TrainNetwork(trainingExamples[i], learningRate);
+        }
+
+        return mse / trainingExamples.size();
+    }
+
+    NeuralNet::EpochOutcome NeuralNet::RunCheckedEpoch(vector<Example> &trainingExamples, double &learningRate, weight_set_type &committed, double previousMSE, bool stopWhenWorse, double &mse, const std::function<bool()> &stop, weight_set_type *rejected)
+    {
+        auto outcome = EpochOutcome::Committed;
+        size_t trained = 0;
+
+        mse = 0.0;
+
+        try
+        {
+            // Check before every example, so long epochs don't hold up stopping
+            for (; trained < trainingExamples.size() && !(stop && stop()); trained++)
+            {
+                trace::Span exampleSpan("example", "train", trained);
+                mse += this->TrainNetwork(trainingExamples[trained], learningRate);
+            }
+        }
+        catch (...)
+        {
+            // Never leave a half trained epoch behind, training and inference would disagree
+            this->AdoptWeights(committed);
+            this->PublishWeights();
+
+            throw;
+        }
+
+        mse /= trainingExamples.size();
+
+        if (trained < trainingExamples.size()) outcome = EpochOutcome::Cancelled;
+        else if (stopWhenWorse && mse > previousMSE) outcome = EpochOutcome::Worse;
+
+        if (outcome == EpochOutcome::Committed)
+        {
+            // Keep the new weights so we can revert to them if later training goes badly
+            committed = this->ShareWeights();
+        }
+        else
+        {
+            if (rejected != nullptr) *rejected = this->ShareWeights();
+
+            // Flip back to the previous weights
+            this->AdoptWeights(committed);
+        }
+
+        this->PublishWeights();
+
+        return outcome;
+    }
+
+
+    double NeuralNet::Backpropagate(const double *targetOutput, const double *out)
+    {
+        trace::Span backwardSpan("backward", "train");
+
+        // The error terms for the neurons live in the arena, with one row per layer
         // Include the hidden error terms
-        auto errorTerms = vector<vector<double>>(this->m_NetArchitecture.size());
+        size_t layerCount = this->m_NetArchitecture.size();
 
         // Get the mean variance from the example to return
         double returnErr = 0.0;
 
-        // Initalise it for the outputs
-        errorTerms[this->m_NetArchitecture.size() - 1] = vector<double>(out->size());
+        // Fill it in for the outputs
+        double *outputErrorTerms = this->m_ErrorTerms + (layerCount - 1) * this->m_Stride;
 
-        for (size_t k = 0; k < out->size(); k++)
+        for (size_t k = 0; k < this->m_NetArchitecture.back(); k++)
         {
             // T4.3
             // errorTerms[this->m_Architecture.size() - 1][k] =
@@ -203,28 +491,26 @@ namespace ai_assignment
             //         )
             //     ) *
             //     (
-            //         trainingExample.targetOutput[k] - out->at(k)
+            //         targetOutput[k] - out->at(k)
             //     )
             // );
 
-            errorTerms[this->m_Architecture.size() - 1][k] = trainingExample.targetOutput[k] - out->at(k);
+            outputErrorTerms[k] = targetOutput[k] - out[k];
 
             // (t - o)²
             // Squared error
-            returnErr += std::pow(trainingExample.targetOutput[k] - out->at(k), 2);
+            returnErr += std::pow(targetOutput[k] - out[k], 2);
         }
 
-        // We're done with the output, free it from the heap
-        delete out;
-
         // Loop over the neurons back to front to "backpropigate"
         // Needs to be signed otherwise it'll underflow to 2⁶⁴ - 1
         // Exclude the output layer, which was already accounted for
-        for (long i = this->m_NetArchitecture.size() - 2; i >= 0; i--)
+        for (long i = layerCount - 2; i >= 0; i--)
         {
-            // Initalise it to the correct size
-            errorTerms[i] = vector<double>(this->m_NetArchitecture[i]);
-            
+            double *errorTerms = this->m_ErrorTerms + i * this->m_Stride;
+            const double *errorTermsAhead = this->m_ErrorTerms + (i + 1) * this->m_Stride;
+            const double *outputs = this->m_Activations + i * this->m_Stride;
+
             // Loop over each unit in this layer
             for (size_t j = 0; j < this->m_NetArchitecture[i]; j++)
             {
@@ -236,100 +522,244 @@ namespace ai_assignment
                 for (size_t k = 0; k < this->m_NetArchitecture[i + 1]; k++)
                 {
                     // j is the input they take from us, i is the layer ahead and k is the node in that layer ahead
-                    sumErr += this->m_Architecture[i + 1][k]->m_Weights->at(j)
+                    sumErr += this->Row(i + 1, k)[j]
                         // We then get the error term of that node
-                        * errorTerms[i + 1][k];
+                        * errorTermsAhead[k];
                 }
-                
-                // Cache the result of the output of this neuron
-                // Slower, but looks neater
-                double o = sharedOutputCache->at(i).at(j);
 
-                errorTerms[i][j] = o * (1.0 - o) * sumErr;
+                double o = outputs[j];
+
+                errorTerms[j] = o * (1.0 - o) * sumErr;
             }
         }
 
-        // Then update the network weights
-        // Every layer
-        for (size_t i = 0; i < this->m_NetArchitecture.size(); i++)
+        backwardSpan.End();
+
+        return returnErr;
+    }
+
+    const double *NeuralNet::ForwardSparse(const weight_set_type &weights, const SparseVector &inputs, double *activations) const
+    {
+        const double *previousOutputs = nullptr;
+        // Values before this index come from earlier layers' outputs, after it they're the inputs carried over
+        size_t prefix = 0;
+
+        for (size_t i = 0; i < weights.size(); i++)
         {
-            // Every neuron
-            for (size_t j = 0; j < this->m_NetArchitecture[i]; j++)
+            trace::Span layerSpan("sparse layer", "inference", i);
+
+            const double *layerWeights = weights[i]->Data();
+            double *outputs = activations + i * this->m_Stride;
+            size_t width = this->m_NetArchitecture[i];
+
+            // Inputs under the prefix have been overwritten by an earlier layer
+            size_t first = std::lower_bound(inputs.indices.begin(), inputs.indices.end(), prefix) - inputs.indices.begin();
+
+            for (size_t j = 0; j < width; j++)
             {
-                // The weights in that neuron
-                // this->m_Inputs == this->m_Architecture[i][j]->m_Weights->size()
-                for (size_t k = 0; k < this->m_Inputs; k++)
+                const double *row = layerWeights + j * this->m_Stride;
+                double net = 0.0;
+
+                // Sums in the same order as Forward, just without the zeros
+                for (size_t k = 0; k < prefix; k++)
                 {
-                    // T4.5
-                    // To get Δw we need the inputs to this neuron, which could be from another neuron or the example
-                    this->m_Architecture[i][j]->m_Weights->at(k) +=
-                    (
-                        learningRate * (
-                            errorTerms[i][j] *
-                            // The input to this weight of the neuron
-                            (
-                                (i == 0)?
-                                    trainingExample.inputs.at(k)
-                                    :
-                                    sharedOutputCache->at(i - 1).at(k)
-                            )
-                        )
-                    );
-
-                    // Give the caller the new weights
-                    newWeights->at(i).at(j).at(k) = this->m_Architecture[i][j]->m_Weights->at(k);
+                    net += previousOutputs[k] * row[k];
+                }
+
+                for (size_t n = first; n < inputs.indices.size(); n++)
+                {
+                    net += inputs.values[n] * row[inputs.indices[n]];
                 }
-                
+
+                outputs[j] = this->m_ActivationFunctions[i](net);
             }
+
+            // Carry over the rest of the prefix
+            for (size_t k = width; k < prefix; k++) outputs[k] = previousOutputs[k];
+
+            previousOutputs = outputs;
+            prefix = std::max(prefix, width);
         }
-        
-        // Return the figure generated earlier as the square error (t - o)
-        // We squared it earlier, which also means we have the absolute value
-        return returnErr;
+
+        return previousOutputs;
     }
 
+    const double *NeuralNet::ForwardBatch(const weight_set_type &weights, const double *inputs, size_t count, double *buffer) const
+    {
+        const double *layerInputs = inputs;
 
-    // Protected Functions
+        for (size_t i = 0; i < weights.size(); i++)
+        {
+            trace::Span layerSpan("layer batch", "inference", i);
+
+            const double *layerWeights = weights[i]->Data();
+            // Alternate between the two halves of the buffer
+            double *outputs = buffer + (i % 2) * count * this->m_Stride;
+            auto &activationFunction = this->m_ActivationFunctions[i];
+
+            // Values carry over to the next layer until a neuron overwrites them
+            std::memcpy(outputs, layerInputs, count * this->m_Stride * sizeof(double));
+
+            // Run the whole batch through each neuron while its weights are in cache
+            Autotuner::Run(this->m_BatchKernels[i], this->LayerShape(i, count), layerWeights, layerInputs, outputs, activationFunction);
+
+            layerInputs = outputs;
+        }
+
+        return layerInputs;
+    }
+
+    const double *NeuralNet::Forward(const weight_set_type &weights, const double *inputs, double *activations) const
+    {
+        const double *layerInputs = inputs;
+
+        // Execute the neurons layer-by-layer
+        for (size_t i = 0; i < weights.size(); i++)
+        {
+            double *outputs = activations + i * this->m_Stride;
+
+            this->ForwardLayer(weights, i, layerInputs, outputs);
+
+            // Use the outputs of this layer as the inputs of the next layer
+            layerInputs = outputs;
+        }
+
+        return layerInputs;
+    }
+
+    void NeuralNet::ForwardLayer(const weight_set_type &weights, size_t i, const double *layerInputs, double *outputs) const
+    {
+        trace::Span layerSpan("layer", "inference", i);
 
+        const double *layerWeights = weights[i]->Data();
 
-    void NeuralNet::InitialiseNeurons(
-        const vector<size_t> &netArchitecture,
-        const size_t inputs,
-        const vector< Neuron::activation_func_type > &activationFunctions,
-        vector< vector < vector< double >* > > *startingWeights
-    )
+        // Values carry over to the next layer until a neuron overwrites them, this keeps the very last value (bias/threshold)
+        std::memcpy(outputs, layerInputs, this->m_Inputs * sizeof(double));
+
+        // Use the output of the previous layer to input into each neuron on this layer
+        Autotuner::Run(this->m_LayerKernels[i], this->LayerShape(i, 1), layerWeights, layerInputs, outputs, this->m_ActivationFunctions[i]);
+    }
+
+    void NeuralNet::TuneKernels()
+    {
+        auto &autotuner = Autotuner::Default();
+
+        this->m_LayerKernels.resize(this->m_NetArchitecture.size());
+        this->m_BatchKernels.resize(this->m_NetArchitecture.size());
+
+        for (size_t i = 0; i < this->m_NetArchitecture.size(); i++)
+        {
+            this->m_LayerKernels[i] = autotuner.Choose(this->LayerShape(i, 1));
+            this->m_BatchKernels[i] = autotuner.Choose(this->LayerShape(i, ForwardBatchSize));
+        }
+    }
+
+    void NeuralNet::PublishWeights()
+    {
+        {
+            auto scopedLock = std::scoped_lock(this->m_PublishLock);
+
+            this->m_PublishedWeights = this->m_Weights;
+        }
+
+        this->m_Version.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    double *NeuralNet::InferenceScratch() const
+    {
+        static thread_local vector<double> scratch;
+
+        size_t size = this->m_NetArchitecture.size() * this->m_Stride;
+
+        if (scratch.size() < size) scratch.resize(size);
+
+        return scratch.data();
+    }
+
+    NeuralNet::weight_set_type NeuralNet::ShareWeights() const
+    {
+        return this->m_Weights;
+    }
+
+    void NeuralNet::AdoptWeights(const weight_set_type &weights) noexcept
+    {
+        this->m_Weights = weights;
+    }
+
+    void NeuralNet::AllocateLayers(const vector< Neuron::activation_func_type > &activationFunctions)
     {
         // Initalise the architecture to the correct size
-        this->m_Architecture = std::vector<std::vector<Neuron*>>(netArchitecture.size());
-        
-        // Create the neurons for each layer
-        for (size_t i = 0; i < netArchitecture.size(); i++)
+        this->m_Weights = weight_set_type(this->m_NetArchitecture.size());
+        this->m_ActivationFunctions = activationFunctions;
+
+        for (size_t i = 0; i < this->m_Weights.size(); i++)
         {
-            // Initalise this layer of the architecture
-            this->m_Architecture.at(i) = std::vector<Neuron*>(netArchitecture[i]);
+            this->m_Weights[i] = std::make_shared<WeightBlock>(this->m_Arena, this->m_NetArchitecture[i] * this->m_Stride);
+        }
+
+        this->AllocateScratch();
+    }
+
+    void NeuralNet::AllocateScratch()
+    {
+        // The scratch space for training, one row per layer
+        this->m_Activations = this->m_Arena->Allocate<double>(this->m_Weights.size() * this->m_Stride);
+        this->m_ErrorTerms = this->m_Arena->Allocate<double>(this->m_Weights.size() * this->m_Stride);
+    }
 
+    void NeuralNet::InitialiseLayers(vector< vector < vector< double >* > > *startingWeights, const Initialiser &initialiser)
+    {
+        // Fill in the neurons for each layer
+        for (size_t i = 0; i < this->m_Weights.size(); i++)
+        {
             // Setup the neurons in this layer
             // There cannot be more than inputs than values in this ANN, since each neuron has exactly the same number of inputs. This is something which could be easily changed in the futire.
-            for (size_t j = 0; j < netArchitecture[i]; j++)
+            double *layerWeights = this->WritableLayer(i);
+
+            // Use randomly generated starting values, each layer from its own stream
+            if (startingWeights == nullptr)
             {
-                // Create the neuron with predefined values
-                if (startingWeights != nullptr)
-                {
-                    // Gives a descript error of what went wrong
-                    if (startingWeights->at(i).at(j) == nullptr) throw std::invalid_argument("All elements of the starting weights must be provided");
-                    
-                    // Crete a new neuron using the provided weights
-                    this->m_Architecture.at(i).at(j) = new Neuron(
-                        inputs - 1,
-                        startingWeights->at(i).at(j),
-                        activationFunctions[i]
-                    );
-                }
-                // Use randomly generated starting values
-                else this->m_Architecture.at(i).at(j) = new Neuron(inputs, activationFunctions[i]);
+                initialiser.Fill(layerWeights, this->m_NetArchitecture[i], this->m_Inputs, this->m_Stride, i);
+                continue;
+            }
+
+            for (size_t j = 0; j < this->m_NetArchitecture[i]; j++)
+            {
+                double *weights = layerWeights + j * this->m_Stride;
+
+                // Copy the predefined values into the arena
+                auto *provided = startingWeights->at(i).at(j);
+
+                // Gives a descript error of what went wrong
+                if (provided == nullptr) throw std::invalid_argument("All elements of the starting weights must be provided");
+                if (provided->size() == this->m_Inputs - 1) throw std::out_of_range("Invalid number of Weights provided, must include an 'extra' weight for the bias/threshold");
+                else if (provided->size() != this->m_Inputs) throw std::out_of_range("Invalid number of Weights provided");
+
+                std::copy(provided->begin(), provided->end(), weights);
+
+                // We have our own copy, so the heap value is no longer needed
+                delete provided;
+                startingWeights->at(i).at(j) = nullptr;
             }
         }
     }
 
-    
-} // End namespace ai_assignment
\ No newline at end of file
+    Arena::Options NeuralNet::SizeArena(const vector<size_t> &netArchitecture, const size_t inputs, Arena::Options arenaOptions) noexcept
+    {
+        size_t stride = Arena::AlignedCount<double>(inputs);
+        // The activations and error terms, one row per layer
+        size_t required = 2 * netArchitecture.size() * stride * sizeof(double);
+
+        // The weights of each layer, and the second buffer training flips between
+        for (auto neurons : netArchitecture)
+        {
+            required += 2 * neurons * stride * sizeof(double);
+        }
+
+        arenaOptions.regionSize = std::max(arenaOptions.regionSize, required);
+
+        return arenaOptions;
+    }
+
+
+} // End namespace ai_assignment
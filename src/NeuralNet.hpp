@@ -4,17 +4,34 @@
 
 #include "NeuralNet.fwd.hpp"
 #include "Neuron.fwd.hpp"
+#include "StreamingTrainer.fwd.hpp"
+#include "TrainingJob.fwd.hpp"
+#include "InferenceSession.fwd.hpp"
+#include "LbfgsTrainer.fwd.hpp"
+#include "LowRankModel.fwd.hpp"
+#include "Initialiser.fwd.hpp"
 
 #include <cmath>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <random>
 #include <vector>
+#include <algorithm>
 #include <cstring>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 
 #include "utils.hpp"
+#include "Arena.hpp"
+#include "Autotuner.hpp"
+#include "Trace.hpp"
+#include "Initialiser.hpp"
 #include "Neuron.hpp"
+#include "WeightBlock.hpp"
+#include "SparseVector.hpp"
 #include "TrainingExample.hpp"
 
 
@@ -22,18 +39,57 @@ namespace ai_assignment
 {
     // Make the code more readable, scope the statement to not interfere with future libraries
     using std::vector;
-    
+
     /**
      * @brief A network of artifical neurons, thread safe. Bias/threshold is final value of input
      */
     class NeuralNet
     {
+        // Declarations
+
+        friend StreamingTrainer;
+        friend TrainingJob;
+        friend InferenceSession;
+        friend LbfgsTrainer;
+        friend LowRankModel;
+
+
         public:
 
             // Definitions
-            
+
             typedef TrainingExample<std::vector<double>>    Example;
+            typedef TrainingExample<std::vector<double>, SparseVector> SparseExample;
             typedef vector<vector<vector<double>>>          weight_type;
+            typedef vector<std::shared_ptr<WeightBlock>>    weight_set_type;
+
+            /**
+             * @brief Metrics from Evaluate
+             */
+            struct Evaluation
+            {
+                size_t examples = 0;
+
+                /**
+                 * @brief The squared error summed over the outputs, averaged over the examples. The same measure as the epoch MSE of TrainNetwork
+                 */
+                double mse = 0.0;
+
+                /**
+                 * @brief The absolute error summed over the outputs, averaged over the examples
+                 */
+                double mae = 0.0;
+
+                /**
+                 * @brief The fraction of examples whose predicted class matches their target's. The class is the largest output, or for a single output whether it's at least 0.5
+                 */
+                double accuracy = 0.0;
+
+                /**
+                 * @brief Counts of examples by target class (row) and predicted class (column)
+                 */
+                vector<vector<size_t>> confusion;
+            };
 
 
             // Constructors
@@ -41,35 +97,37 @@ namespace ai_assignment
 
             /**
              * @brief Construct a new Neuron Net according to some patterns. Does not properly verify the net structure and will produce undefined behaviour if it's invalid
-             * 
+             *
              * @param netArchitecture The layout of the neurons. Each element represents the number of neurons in that layer
              * @param inputArchitecture The number of inputs each neuron takes. Must include bias/threshold. Values will carry-over until a neuron overwrites them (i.e. the last value can be used as a bias/threshold)
              * @param activationFunctions The activation function to use for each individual layer
-             * @param startingWeights The weights to apply to each neuron. Must contain every single weight. A weight (l) set of weights (k*) is part of a neuron (j) which is part of a layer (i). Auto-generates weights if nullptr. WARNING: This needs to be on the heap. It's disposed immediately after the neurons have been created. The neuron has ownership of the nested heap value, which is released when the neuron gets deleted when the NeuralNet gets freed
+             * @param startingWeights The weights to apply to each neuron. Must contain every single weight. A weight (l) set of weights (k*) is part of a neuron (j) which is part of a layer (i). Auto-generates weights if nullptr. WARNING: This needs to be on the heap. The weights are copied into the net's arena, then the collection and every nested heap value is disposed of
+             * @param arenaOptions How to map the memory for the weights and training buffers. The arena is sized to fit the whole net in one region
+             * @param initialiser How to generate the weights when there are no starting weights. Each layer draws from its own stream, so a seeded initialiser always gives the same net
              */
             NeuralNet(
                 const vector<size_t> netArchitecture,
                 const size_t inputs,
                 const vector< Neuron::activation_func_type > activationFunctions,
-                vector< vector < vector< double >* > > *startingWeights = nullptr
+                vector< vector < vector< double >* > > *startingWeights = nullptr,
+                const Arena::Options &arenaOptions = Arena::Options(),
+                const Initialiser &initialiser = Initialiser()
             );
 
             /**
-             * @brief The copy constructor
-             * 
+             * @brief The copy constructor. The weights of each layer are shared with obj until either net writes to that layer, at which point the writer takes its own copy of the layer. Allocates the copy's own scratch space, which may throw std::bad_alloc
+             *
              * @note We don't copy the mutex since it needs to be reset, nor do we copy the heuristics since it needs to be completely re-created
-             * 
+             *
              * @param obj object to copy
              */
-            NeuralNet(const NeuralNet &obj) noexcept;
+            NeuralNet(const NeuralNet &obj);
 
             /**
-             * @brief Destroy the NeuralNet object
+             * @brief Destroy the NeuralNet object (layers go back to their arena once no other net shares them)
              */
             inline virtual ~NeuralNet() noexcept
-            {
-                utils::releaseVecValues<Neuron>(this->m_Architecture);
-            }
+            {}
 
             // Accessors
 
@@ -78,32 +136,139 @@ namespace ai_assignment
              */
             inline weight_type *GetWeights() const noexcept
             {
-                auto *out = new weight_type(this->m_Architecture.size());
+                auto *out = new weight_type(this->m_Weights.size());
 
                 for (size_t i = 0; i < out->size(); i++)
                 {
                     out->at(i) = vector<vector<double>>(this->m_NetArchitecture.at(i));
-                    
+
                     for (size_t j = 0; j < out->at(i).size(); j++)
                     {
+                        const double *row = this->Row(i, j);
+
                         // Create a copy on the "stack" of the heap of the output of each neuron's weight
-                        out->at(i).at(j) = vector<double>(*this->m_Architecture.at(i).at(j)->m_Weights);
+                        out->at(i).at(j) = vector<double>(row, row + this->m_Inputs);
                     }
                 }
 
                 return out;
             }
 
-            inline void SetWeights(weight_type *newWeights) const noexcept
+            /**
+             * @brief Overwrite the weights, then publish them. Layers still shared with another net are copied first, which may throw std::bad_alloc. Thread safe
+             */
+            inline void SetWeights(weight_type *newWeights)
             {
+                auto scopedLock = std::scoped_lock(this->m_Lock);
+
                 for (size_t i = 0; i < newWeights->size(); i++)
                 {
+                    double *layer = this->WritableLayer(i);
+
                     for (size_t j = 0; j < newWeights->at(i).size(); j++)
                     {
-                        // Create a copy on the "stack" of the heap of the output of each neuron's weight
-                        *this->m_Architecture.at(i).at(j)->m_Weights = newWeights->at(i).at(j);
+                        auto &weights = newWeights->at(i).at(j);
+
+                        // Copy into the neuron's row of the layer, ignoring any extra weights
+                        std::copy_n(weights.begin(), std::min(weights.size(), this->m_Inputs), layer + j * this->m_Stride);
                     }
                 }
+
+                this->PublishWeights();
+            }
+
+            /**
+             * @brief Capture the current weights without copying them. The layers are shared with the net until it next writes to them, and that write copies the whole layer. Thread safe
+             *
+             * @return weight_set_type One block per layer, to give back to Restore
+             */
+            inline weight_set_type Snapshot() const
+            {
+                auto scopedLock = std::scoped_lock(this->m_Lock);
+
+                return this->ShareWeights();
+            }
+
+            /**
+             * @brief Go back to weights captured by Snapshot, without copying them, then publish them. Thread safe
+             *
+             * @param snapshot A snapshot of this net, or a net with the same architecture
+             */
+            inline void Restore(const weight_set_type &snapshot)
+            {
+                auto scopedLock = std::scoped_lock(this->m_Lock);
+
+                if (snapshot.size() != this->m_Weights.size()) throw std::invalid_argument("Snapshot doesn't match architecture");
+
+                for (size_t i = 0; i < snapshot.size(); i++)
+                {
+                    if (snapshot[i]->Size() != this->m_Weights[i]->Size()) throw std::invalid_argument("Snapshot doesn't match architecture");
+                }
+
+                this->AdoptWeights(snapshot);
+                this->PublishWeights();
+            }
+
+            /**
+             * @brief Make the current weights the ones ProcessInputs uses. Only needed after calling the single example TrainNetwork directly, everything else publishes for you. Thread safe
+             */
+            inline void Publish()
+            {
+                auto scopedLock = std::scoped_lock(this->m_Lock);
+
+                this->PublishWeights();
+            }
+
+            /**
+             * @brief A counter which goes up every time new weights are published
+             */
+            inline uint64_t Version() const noexcept
+            {
+                return this->m_Version.load(std::memory_order_acquire);
+            }
+
+            /**
+             * @brief The number of bytes mapped for the weights and training buffers of this net. Layers shared with another net count towards the net which allocated them
+             */
+            inline size_t MemoryFootprint() const noexcept
+            {
+                return this->m_Arena->Footprint();
+            }
+
+            /**
+             * @brief The arena holding the weights and training buffers
+             */
+            inline const Arena &GetArena() const noexcept
+            {
+                return *this->m_Arena;
+            }
+
+            /**
+             * @brief The kernel the autotuner picked for layer i, for one input at a time (Forward) or for batches (ForwardBatch)
+             */
+            inline Autotuner::Kernel GetKernel(size_t i, bool batched = false) const noexcept
+            {
+                return (batched)? this->m_BatchKernels[i] : this->m_LayerKernels[i];
+            }
+
+            /**
+             * @brief The number of layers whose weights are still shared with another net, a snapshot or an inference call in flight
+             */
+            inline size_t SharedLayerCount() const
+            {
+                auto scopedLock = std::scoped_lock(this->m_Lock, this->m_PublishLock);
+
+                size_t shared = 0;
+
+                for (size_t i = 0; i < this->m_Weights.size(); i++)
+                {
+                    // Discount our own references: m_Weights, and m_PublishedWeights if it's the same block
+                    long ours = 1 + (this->m_PublishedWeights[i] == this->m_Weights[i]);
+
+                    if (this->m_Weights[i].use_count() > ours) shared++;
+                }
+
+                return shared;
             }
 
             /**
@@ -111,34 +276,40 @@ namespace ai_assignment
              */
             inline void PrintWeights(std::fstream &out) const noexcept
             {
-                auto *w = this->GetWeights();
+                this->PrintWeights(out, this->m_Weights);
+            }
 
+            /**
+             * @brief Prints a set of weights of this net to a csv file stream
+             */
+            inline void PrintWeights(std::fstream &out, const weight_set_type &weights) const noexcept
+            {
                 // Each layer
-                for (size_t i = 0; i < w->size(); i++)
+                for (size_t i = 0; i < weights.size(); i++)
                 {
                     // Each neuron
-                    for (size_t j = 0; j < w->at(i).size(); j++)
+                    for (size_t j = 0; j < this->m_NetArchitecture.at(i); j++)
                     {
+                        const double *row = weights[i]->Data() + j * this->m_Stride;
+
                         // Each weight
-                        for (size_t k = 0; k < w->at(i).at(j).size(); k++)
+                        for (size_t k = 0; k < this->m_Inputs; k++)
                         {
                             // Amend the weight to the file
-                            out << w->at(i).at(j).at(k) << ',';
+                            out << row[k] << ',';
                         }
                     }
                 }
 
                 out << std::endl;
-
-                delete w;
             }
 
             // Functions
 
 
             /**
-             * @brief Runs through the net and returns the results. Not thread safe
-             * 
+             * @brief Runs through the net and returns the results. Thread safe, uses the last published weights so it never waits on training
+             *
              * @param inputs The inputs to the net. The last value of the inputs is the bias/threshold which is in all layers until overwritten by a neuron
              * @param recordedOutputs If provided, records each individual output. This excludes the final output, and should therefore have a size of layers * inputs
              * @return double The results from the final layer of the network
@@ -146,8 +317,24 @@ namespace ai_assignment
             vector<double> *ProcessInputs(vector<double> inputs, vector<vector<double>> *recordedOutputs = nullptr);
 
             /**
-             * @brief Trains the neural network until the mean squared error stops changing. Thread safe
-             * 
+             * @brief Runs sparse inputs through the net, only reading the weights of the non-zero inputs. Gives the same results as the dense ProcessInputs. Thread safe, uses the last published weights
+             *
+             * @param inputs The inputs to the net, with a dimension of the number of inputs. Still needs the bias/threshold as the last input
+             * @return double The results from the final layer of the network
+             */
+            vector<double> *ProcessInputs(const SparseVector &inputs);
+
+            /**
+             * @brief Score the net on a set of examples without training on them. Examples are split into fixed size shards which run in parallel, and the shards' sums are combined in order, so the result doesn't depend on the number of threads. Thread safe, uses the last published weights
+             *
+             * @param examples The examples to score
+             * @param threads The number of threads to use, zero uses one per core
+             */
+            Evaluation Evaluate(const vector<Example> &examples, size_t threads = 0) const;
+
+            /**
+             * @brief Trains the neural network until the mean squared error stops changing, publishing the weights after every epoch which improves the error. Thread safe
+             *
              * @param trainingExamples Examples to give the net for it to "learn"
              * @param learningRate The learning rate
              * @return The number of epochs taken to fully train the network
@@ -155,56 +342,427 @@ namespace ai_assignment
             size_t TrainNetwork(vector<Example> &trainingExamples, double learningRate);
 
             /**
-             * @brief Trains the neural network for one epoch, then returns the error rate. Not thread safe
-             * 
+             * @brief Trains the neural network on every example once, then publishes the weights. Thread safe
+             *
+             * @param trainingExamples Examples to give the net for it to "learn"
+             * @param learningRate The learning rate
+             * @return double The mean squared error of the epoch
+             */
+            double TrainEpoch(vector<Example> &trainingExamples, double learningRate);
+
+            /**
+             * @brief Trains the neural network on every sparse example once, then publishes the weights. Thread safe
+             *
+             * @param trainingExamples Examples to give the net for it to "learn"
+             * @param learningRate The learning rate
+             * @return double The mean squared error of the epoch
+             */
+            double TrainEpoch(vector<SparseExample> &trainingExamples, double learningRate);
+
+            /**
+             * @brief The number of weights in the net, the size of GetParameters
+             */
+            inline size_t ParameterCount() const noexcept
+            {
+                size_t neurons = 0;
+
+                for (auto layerSize : this->m_NetArchitecture) neurons += layerSize;
+
+                return neurons * this->m_Inputs;
+            }
+
+            /**
+             * @brief Get a flat copy of every weight, neuron by neuron and layer by layer. Thread safe
+             */
+            vector<double> GetParameters() const;
+
+            /**
+             * @brief Overwrite every weight from a flat copy in the layout of GetParameters, then publish them. Thread safe
+             */
+            void SetParameters(const vector<double> &parameters);
+
+            /**
+             * @brief Trains the neural network with one example, then returns the error rate. The update isn't published. Not thread safe
+             *
+             * @param trainingExample The example to give the net for it to "learn"
+             * @param learningRate The learning rate
+             * @return double The error of the net: netTarget - netOutput
+             */
+            double TrainNetwork(Example &trainingExample, double &learningRate);
+
+            /**
+             * @brief As TrainNetwork above, also handing back the outputs of each layer and the new weights, as it did before the weights moved into the arena. Not thread safe
+             *
              * @param trainingExample The example to give the net for it to "learn"
              * @param learningRate The learning rate
-             * @param sharedOutputCache A shared variable to reduce overhead
-             * @param newWeights Must be initialised to the correct size. Is set to the new values of the weights as an optimisation step over creating a new loop counter elsewhere
+             * @param sharedOutputCache If not nullptr, must have one entry per layer. Each is set to that layer's m_Inputs outputs, including the values carried over
+             * @param newWeights If not nullptr, must be initialised to the correct size. Is set to the new values of the weights
              * @return double The error of the net: netTarget - netOutput
              */
             double TrainNetwork(Example &trainingExample, double &learningRate, vector<vector<double>> *sharedOutputCache, weight_type *newWeights);
 
+            /**
+             * @brief Trains the neural network with one sparse example, then returns the error rate. Only the weights of the non-zero inputs (and of earlier layers' outputs) are updated, since the rest would be left alone anyway. The update isn't published. Not thread safe
+             *
+             * @param trainingExample The example to give the net for it to "learn"
+             * @param learningRate The learning rate
+             * @return double The error of the net: netTarget - netOutput
+             */
+            double TrainNetwork(SparseExample &trainingExample, double &learningRate);
+
         protected:
 
+            // Definitions
+
+            /**
+             * @brief How an epoch run by RunCheckedEpoch ended
+             */
+            enum class EpochOutcome
+            {
+                // Kept, and now the committed weights
+                Committed,
+                // Rolled back for making the error worse
+                Worse,
+                // Rolled back for being cut short
+                Cancelled
+            };
+
             // Properties
 
 
             /**
-             * @brief The neurons
+             * @brief Holds the weights and training buffers of the net. Kept alive by any layer shared with another net
              */
-            vector<vector<Neuron*>> m_Architecture;
+            std::shared_ptr<Arena> m_Arena;
+
+            /**
+             * @brief The weights of each layer of neurons, one row of m_Stride values per neuron. Blocks may be shared with other nets and snapshots, so must be detached by WritableLayer before being written to
+             */
+            weight_set_type m_Weights;
+
+            /**
+             * @brief The activation function of each layer
+             */
+            vector< Neuron::activation_func_type > m_ActivationFunctions;
 
             /**
              * @brief The number of inputs each neuron takes
              */
             const size_t m_Inputs;
 
+            /**
+             * @brief The distance between rows of weights, m_Inputs rounded up to fill whole cache lines
+             */
+            const size_t m_Stride;
+
             /**
              * @brief The architecture of the net
              */
             const vector<size_t> m_NetArchitecture;
 
             /**
-             * @brief A mutex to guard m_ConnectionHeuristic and m_Architecture
+             * @brief The outputs of each layer from the last forward pass, including the values carried over from the layer before. One row of m_Stride values per layer
+             */
+            double *m_Activations;
+
+            /**
+             * @brief The error terms of each neuron from the last backward pass. One row of m_Stride values per layer
+             */
+            double *m_ErrorTerms;
+
+            /**
+             * @brief A mutex to guard m_Weights and the training buffers
              */
             mutable std::mutex m_Lock;
 
+            /**
+             * @brief The weights inference runs against. Shares blocks with m_Weights as of the last publish
+             */
+            weight_set_type m_PublishedWeights;
+
+            /**
+             * @brief Goes up every time weights are published
+             */
+            std::atomic<uint64_t> m_Version = 0;
+
+            /**
+             * @brief A mutex to guard m_PublishedWeights, only ever held long enough to copy the set
+             */
+            mutable std::mutex m_PublishLock;
+
+            /**
+             * @brief The kernel of each layer for Forward, picked by the autotuner
+             */
+            vector<Autotuner::Kernel> m_LayerKernels;
+
+            /**
+             * @brief The kernel of each layer for ForwardBatch, picked by the autotuner for batches of ForwardBatchSize
+             */
+            vector<Autotuner::Kernel> m_BatchKernels;
+
+
+            // Accessors
+
+            /**
+             * @brief The weights of neuron j in layer i, read only since the layer may be shared
+             */
+            inline const double *Row(size_t i, size_t j) const noexcept
+            {
+                return this->m_Weights[i]->Data() + j * this->m_Stride;
+            }
+
+            /**
+             * @brief The weights of layer i, ready to be written to. Takes a private copy of the layer first if it's shared with another net. Not thread safe
+             */
+            inline double *WritableLayer(size_t i)
+            {
+                auto &weights = this->m_Weights[i];
+
+                if (weights.use_count() > 1) weights = std::make_shared<WeightBlock>(this->m_Arena, *weights);
+
+                return weights->Data();
+            }
 
             // Functions
 
             /**
-             * @brief Initialise the neurons
+             * @brief Trains on every example once. Not thread safe
+             *
+             * @return double The mean squared error of the epoch
              */
-            void InitialiseNeurons(
-                const vector<size_t> &netArchitecture,
-                const size_t inputs,
-                const vector< Neuron::activation_func_type > &activationFunctions,
-                vector< vector < vector< double >* > > *startingWeights = nullptr
-            );
+            double RunEpoch(vector<Example> &trainingExamples, double &learningRate);
+
+            /**
+             * @brief Trains on every example once, then keeps the epoch or rolls it back. Epochs cut short by stop, worse than previousMSE (if stopWhenWorse), or which throw go back to committed. Kept epochs become committed. Either way the weights are published. The epoch loop of TrainNetwork and TrainingJob. Not thread safe
+             *
+             * @param committed The weights of the last kept epoch, to roll back to. Set to the new weights if this epoch is kept
+             * @param mse Set to the mean squared error of the epoch
+             * @param stop Checked before each example, ends the epoch early once it returns true. May be empty
+             * @param rejected If not nullptr, set to the weights of an epoch which was rolled back, so they can still be looked at
+             */
+            EpochOutcome RunCheckedEpoch(vector<Example> &trainingExamples, double &learningRate, weight_set_type &committed, double previousMSE, bool stopWhenWorse, double &mse, const std::function<bool()> &stop, weight_set_type *rejected = nullptr);
+
+            /**
+             * @brief The number of examples in each shard of Evaluate, fixed so the order of summing never changes
+             */
+            static constexpr size_t EvaluationShardSize = 1024;
+
+            /**
+             * @brief The body of Evaluate, shared with LowRankModel. Runs each shard of the examples on the executor and sums its errors, then combines the shards in order, so the results never depend on the number of threads
+             *
+             * @tparam ForwardShard Callable as forwardShard(begin, end, emit), which runs examples [begin, end) and calls emit(e, outputs) with the outputs of each example e
+             * @param inputCount The number of inputs each example must have
+             * @param outputCount The number of outputs, and targets each example must have
+             */
+            template<typename ForwardShard>
+            static Evaluation EvaluateShards(const vector<Example> &examples, size_t inputCount, size_t outputCount, size_t threads, ForwardShard forwardShard)
+            {
+                // A single output is a yes/no classifier
+                size_t classes = (outputCount == 1)? 2 : outputCount;
+
+                for (auto &example : examples)
+                {
+                    if (example.inputs.size() != inputCount) throw std::invalid_argument("Input provided doesn't match architecture");
+                    if (example.targetOutput.size() != outputCount) throw std::invalid_argument("Target output doesn't match architecture");
+                }
+
+                auto classOf = [outputCount](const double *values) -> size_t
+                {
+                    if (outputCount == 1) return (values[0] >= 0.5)? 1 : 0;
+
+                    return std::max_element(values, values + outputCount) - values;
+                };
+
+                // The sums for each shard
+                struct Partial
+                {
+                    double squaredError = 0.0;
+                    double absoluteError = 0.0;
+                    vector<size_t> confusion;
+                };
+
+                size_t shards = (examples.size() + EvaluationShardSize - 1) / EvaluationShardSize;
+                auto partials = vector<Partial>(shards);
+
+                utils::parallelFor(shards, [&](size_t s)
+                {
+                    trace::Span shardSpan("evaluate shard", "inference", s);
+
+                    auto &partial = partials[s];
+                    partial.confusion.resize(classes * classes);
+
+                    size_t begin = s * EvaluationShardSize;
+                    size_t end = std::min(examples.size(), begin + EvaluationShardSize);
+
+                    forwardShard(begin, end, [&](size_t e, const double *out)
+                    {
+                        const double *target = examples[e].targetOutput.data();
+
+                        for (size_t k = 0; k < outputCount; k++)
+                        {
+                            double error = target[k] - out[k];
+
+                            partial.squaredError += error * error;
+                            partial.absoluteError += std::abs(error);
+                        }
+
+                        partial.confusion[classOf(target) * classes + classOf(out)]++;
+                    });
+                }, threads);
+
+                // Combine the shards in order
+                auto evaluation = Evaluation();
+                evaluation.examples = examples.size();
+                evaluation.confusion = vector<vector<size_t>>(classes, vector<size_t>(classes));
+
+                size_t correct = 0;
+
+                for (auto &partial : partials)
+                {
+                    evaluation.mse += partial.squaredError;
+                    evaluation.mae += partial.absoluteError;
+
+                    for (size_t actual = 0; actual < classes; actual++)
+                    {
+                        for (size_t predicted = 0; predicted < classes; predicted++)
+                        {
+                            evaluation.confusion[actual][predicted] += partial.confusion[actual * classes + predicted];
+                        }
+                    }
+                }
+
+                for (size_t c = 0; c < classes; c++) correct += evaluation.confusion[c][c];
+
+                if (!examples.empty())
+                {
+                    evaluation.mse /= examples.size();
+                    evaluation.mae /= examples.size();
+                    evaluation.accuracy = static_cast<double>(correct) / examples.size();
+                }
+
+                return evaluation;
+            }
+
+            /**
+             * @brief The number of examples ForwardBatch runs through each neuron at once, while its weights are in cache
+             */
+            static constexpr size_t ForwardBatchSize = 32;
+
+            /**
+             * @brief Propagates a batch of inputs through the net a layer at a time, giving the same results as Forward on each. Thread safe as long as nothing writes to the weights
+             *
+             * @param weights The weights to use, either m_Weights or a published set
+             * @param inputs count rows of m_Stride values, each starting with the m_Inputs inputs
+             * @param count The number of rows
+             * @param buffer Space for two layers of outputs, 2 ⨉ count ⨉ m_Stride values
+             * @return const double* The outputs of the final layer, one row of m_Stride values per input, inside buffer
+             */
+            const double *ForwardBatch(const weight_set_type &weights, const double *inputs, size_t count, double *buffer) const;
+
+            /**
+             * @brief Propagates the inputs through the net. Thread safe as long as nothing writes to the weights
+             *
+             * @param weights The weights to use, either m_Weights or a published set
+             * @param inputs m_Inputs values, including the bias/threshold
+             * @param activations Filled with the outputs of each layer, one row of m_Stride values per layer
+             * @return const double* The outputs of the final layer
+             */
+            const double *Forward(const weight_set_type &weights, const double *inputs, double *activations) const;
+
+            /**
+             * @brief Propagates sparse inputs through the net. Layer i's inputs are the outputs of earlier layers up to the widest of them, followed by the inputs carried over, so only that dense prefix and the non-zero inputs past it are summed. Thread safe as long as nothing writes to the weights
+             *
+             * @param weights The weights to use, either m_Weights or a published set
+             * @param inputs The inputs, already validated
+             * @param activations Filled with the dense prefix of each layer's outputs, one row of m_Stride values per layer
+             * @return const double* The outputs of the final layer
+             */
+            const double *ForwardSparse(const weight_set_type &weights, const SparseVector &inputs, double *activations) const;
+
+            /**
+             * @brief Fills in the error terms of every layer from the last forward pass into m_Activations. Not thread safe
+             *
+             * @param targetOutput The target of each output
+             * @param out The outputs of the final layer
+             * @return double The squared error summed over the outputs
+             */
+            double Backpropagate(const double *targetOutput, const double *out);
+
+            /**
+             * @brief Propagates the outputs of the layer before through layer i. Thread safe as long as nothing writes to the weights
+             *
+             * @param weights The weights to use, either m_Weights or a published set
+             * @param i The layer to run
+             * @param layerInputs m_Inputs values, the inputs to the net or the outputs of the layer before
+             * @param outputs Filled with m_Inputs values, the outputs of the layer followed by whatever carried over from layerInputs
+             */
+            void ForwardLayer(const weight_set_type &weights, size_t i, const double *layerInputs, double *outputs) const;
+
+            /**
+             * @brief Share the current weights with inference, and bump the version. Not thread safe
+             */
+            void PublishWeights();
+
+            /**
+             * @brief The weights inference should use. Thread safe
+             */
+            inline weight_set_type PublishedWeights() const
+            {
+                auto scopedLock = std::scoped_lock(this->m_PublishLock);
+
+                return this->m_PublishedWeights;
+            }
+
+            /**
+             * @brief A per thread buffer with room for the activations of every layer, for inference
+             */
+            double *InferenceScratch() const;
+
+            /**
+             * @brief Shares the weights of every layer, the net copies a layer when it next writes to it. Not thread safe
+             */
+            weight_set_type ShareWeights() const;
+
+            /**
+             * @brief Points every layer at the blocks of a weight set, the inverse of ShareWeights. Not thread safe
+             */
+            void AdoptWeights(const weight_set_type &weights) noexcept;
+
+            /**
+             * @brief Allocates the weights and training buffers from the arena
+             */
+            void AllocateLayers(const vector< Neuron::activation_func_type > &activationFunctions);
+
+            /**
+             * @brief Allocates the training buffers from the arena
+             */
+            void AllocateScratch();
+
+            /**
+             * @brief Initialise the weights of each layer
+             */
+            void InitialiseLayers(vector< vector < vector< double >* > > *startingWeights, const Initialiser &initialiser);
+
+            /**
+             * @brief Picks the kernel of each layer, timing the kernels on any layer shape the autotuner hasn't seen on this machine before
+             */
+            void TuneKernels();
+
+            /**
+             * @brief The shape layer i runs its kernel on, for a batch of inputs
+             */
+            inline Autotuner::Shape LayerShape(size_t i, size_t batch) const noexcept
+            {
+                return { .inputs = this->m_Inputs, .stride = this->m_Stride, .neurons = this->m_NetArchitecture[i], .batch = batch };
+            }
+
+            /**
+             * @brief Gives the arena a region size which fits every buffer the net allocates (bar copies of shared layers), so the net lives in one region
+             */
+            static Arena::Options SizeArena(const vector<size_t> &netArchitecture, const size_t inputs, Arena::Options arenaOptions) noexcept;
     };
-    
+
 } // End namespace ai_assignment
 
 
-#endif // H_530093_SRC_NEURAL_NET
\ No newline at end of file
+#endif // H_530093_SRC_NEURAL_NET
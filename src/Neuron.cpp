@@ -1,5 +1,9 @@
 #include "Neuron.hpp"
 
+#include <atomic>
+
+#include "Initialiser.hpp"
+
 namespace ai_assignment
 {
     // Public constructors
@@ -85,18 +89,15 @@ namespace ai_assignment
 
     std::vector<double> *Neuron::GenerateRandomWeights(size_t inputCount)
     {
+        // Seeded once per process, rather than opening std::random_device for every neuron
+        static const Initialiser initialiser;
+        static std::atomic<uint64_t> nextStream = 0;
+
         auto *weights = new std::vector<double>(inputCount + 1);
 
-        std::random_device rng;
-        std::uniform_real_distribution<double> range(-0.05, 0.05);
+        // Every neuron draws from its own stream
+        initialiser.Fill(weights->data(), 1, inputCount + 1, inputCount + 1, nextStream.fetch_add(1, std::memory_order_relaxed));
 
-        for (size_t i = 0; i < inputCount; i++)
-        {
-            weights->at(i) = range(rng);
-        }
-
-        weights->at(inputCount) = 1.0l;
-        
         return weights;
     }
 }
\ No newline at end of file
@@ -0,0 +1,85 @@
+#pragma once
+#ifndef H_530093_SRC_SPARSE_VECTOR
+#define H_530093_SRC_SPARSE_VECTOR 1
+
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+
+
+namespace ai_assignment
+{
+    /**
+     * @brief A vector which only stores its non-zero values, as (index, value) pairs in ascending order of index
+     */
+    struct SparseVector
+    {
+        /**
+         * @brief The length of the equivalent dense vector
+         */
+        size_t dimension = 0;
+
+        std::vector<size_t> indices;
+        std::vector<double> values;
+
+        /**
+         * @brief The number of values stored
+         */
+        inline size_t NonZeros() const noexcept
+        {
+            return this->indices.size();
+        }
+
+        /**
+         * @brief Store a value, which must come after every value already stored
+         */
+        inline void Push(size_t index, double value)
+        {
+            if (index >= this->dimension) throw std::out_of_range("Index is past the end of the vector");
+            if (!this->indices.empty() && index <= this->indices.back()) throw std::invalid_argument("Indices must be in ascending order");
+
+            this->indices.push_back(index);
+            this->values.push_back(value);
+        }
+
+        /**
+         * @brief Check the indices are ascending and inside the vector
+         */
+        inline void Validate() const
+        {
+            if (this->indices.size() != this->values.size()) throw std::invalid_argument("Every index needs a value");
+
+            for (size_t i = 0; i < this->indices.size(); i++)
+            {
+                if (this->indices[i] >= this->dimension) throw std::out_of_range("Index is past the end of the vector");
+                if (i > 0 && this->indices[i] <= this->indices[i - 1]) throw std::invalid_argument("Indices must be in ascending order");
+            }
+        }
+
+        static inline SparseVector FromDense(const std::vector<double> &dense)
+        {
+            auto sparse = SparseVector();
+            sparse.dimension = dense.size();
+
+            for (size_t i = 0; i < dense.size(); i++)
+            {
+                if (dense[i] != 0.0) sparse.Push(i, dense[i]);
+            }
+
+            return sparse;
+        }
+
+        inline std::vector<double> ToDense() const
+        {
+            auto dense = std::vector<double>(this->dimension);
+
+            for (size_t i = 0; i < this->indices.size(); i++) dense[this->indices[i]] = this->values[i];
+
+            return dense;
+        }
+    };
+
+} // End namespace ai_assignment
+
+
+#endif // H_530093_SRC_SPARSE_VECTOR
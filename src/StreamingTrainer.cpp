@@ -0,0 +1,220 @@
+#include "StreamingTrainer.hpp"
+
+
+namespace ai_assignment
+{
+    // Public Constructors
+
+
+    StreamingTrainer::StreamingTrainer(NeuralNet &net, const Options &options)
+        : m_Net(net),
+            m_Options(options),
+            m_Worker([this](std::stop_token stopToken) { this->Run(stopToken); })
+    {}
+
+    StreamingTrainer::~StreamingTrainer() noexcept
+    {
+        this->Shutdown();
+    }
+
+
+    // Public Functions
+
+
+    bool StreamingTrainer::Push(Example example)
+    {
+        if (example.inputs.size() != this->m_Net.m_Inputs) throw std::invalid_argument("Input provided doesn't match architecture");
+        if (example.targetOutput.size() != this->m_Net.m_NetArchitecture.back()) throw std::invalid_argument("Target output doesn't match architecture");
+
+        auto lock = std::unique_lock(this->m_Lock);
+
+        // Wait for room, this is what bounds our memory use
+        this->m_Popped.wait(lock, [this]() { return this->m_Stopped || this->m_Queue.size() < this->m_Options.queueCapacity; });
+
+        if (this->m_Stopped) return false;
+
+        this->m_Queue.push_back(std::move(example));
+
+        lock.unlock();
+        this->m_Pushed.notify_one();
+
+        return true;
+    }
+
+    bool StreamingTrainer::Push(std::vector<Example> &&examples)
+    {
+        for (auto &example : examples)
+        {
+            if (!this->Push(std::move(example))) return false;
+        }
+
+        return true;
+    }
+
+    bool StreamingTrainer::TryPush(Example example)
+    {
+        if (example.inputs.size() != this->m_Net.m_Inputs) throw std::invalid_argument("Input provided doesn't match architecture");
+        if (example.targetOutput.size() != this->m_Net.m_NetArchitecture.back()) throw std::invalid_argument("Target output doesn't match architecture");
+
+        auto lock = std::unique_lock(this->m_Lock);
+
+        if (this->m_Stopped || this->m_Queue.size() >= this->m_Options.queueCapacity) return false;
+
+        this->m_Queue.push_back(std::move(example));
+
+        lock.unlock();
+        this->m_Pushed.notify_one();
+
+        return true;
+    }
+
+    void StreamingTrainer::Flush()
+    {
+        auto lock = std::unique_lock(this->m_Lock);
+
+        this->m_Popped.wait(lock, [this]() { return this->m_Stopped || (this->m_Queue.empty() && !this->m_Busy); });
+
+        if (this->m_Failure) std::rethrow_exception(this->m_Failure);
+
+        lock.unlock();
+
+        this->m_Net.Publish();
+        this->m_Publishes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void StreamingTrainer::Stop()
+    {
+        this->Shutdown();
+
+        auto scopedLock = std::scoped_lock(this->m_Lock);
+
+        if (this->m_Failure) std::rethrow_exception(this->m_Failure);
+    }
+
+
+    // Protected Functions
+
+
+    void StreamingTrainer::Shutdown() noexcept
+    {
+        {
+            auto scopedLock = std::scoped_lock(this->m_Lock);
+
+            this->m_Stopped = true;
+            this->m_Queue.clear();
+        }
+
+        // Wakes the background thread through its stop token
+        this->m_Worker.request_stop();
+        this->m_Popped.notify_all();
+
+        if (this->m_Worker.joinable()) this->m_Worker.join();
+    }
+
+    void StreamingTrainer::Run(std::stop_token stopToken)
+    {
+        // Reused for every batch
+        auto batch = std::vector<Example>();
+        batch.reserve(this->m_Options.batchSize);
+
+        double learningRate = this->m_Options.learningRate;
+        size_t sincePublish = 0;
+        auto lastPublish = std::chrono::steady_clock::now();
+
+        while (true)
+        {
+            {
+                auto lock = std::unique_lock(this->m_Lock);
+
+                // Wake up for examples, to stop, or when it's time to publish
+                this->m_Pushed.wait_until(lock, stopToken, lastPublish + this->m_Options.publishInterval, [this]() { return !this->m_Queue.empty(); });
+
+                if (stopToken.stop_requested()) break;
+
+                // Take a batch off the queue
+                while (!this->m_Queue.empty() && batch.size() < this->m_Options.batchSize)
+                {
+                    batch.push_back(std::move(this->m_Queue.front()));
+                    this->m_Queue.pop_front();
+                }
+
+                this->m_Busy = !batch.empty();
+            }
+
+            // Let anyone waiting for room carry on
+            this->m_Popped.notify_all();
+
+            // Woken to publish with nothing to publish, so leave the net alone and wait for a whole interval of examples
+            if (batch.empty() && sincePublish == 0)
+            {
+                lastPublish = std::chrono::steady_clock::now();
+                continue;
+            }
+
+            try
+            {
+                trace::Span lockSpan("lock", "sync");
+                auto scopedLock = std::scoped_lock(this->m_Net.m_Lock);
+                lockSpan.End();
+
+                trace::Span batchSpan("stream batch", "train", batch.size());
+
+                double error = this->m_Error.load(std::memory_order_relaxed);
+                size_t seen = this->m_ExamplesSeen.load(std::memory_order_relaxed);
+
+                for (auto &example : batch)
+                {
+                    double squaredError = this->m_Net.TrainNetwork(example, learningRate);
+
+                    // Start the average from the first example rather than zero
+                    error = (seen == 0)? squaredError : (1.0 - this->m_Options.errorDecay) * error + this->m_Options.errorDecay * squaredError;
+                    seen++;
+                }
+
+                this->m_Error.store(error, std::memory_order_relaxed);
+                this->m_ExamplesSeen.store(seen, std::memory_order_relaxed);
+
+                sincePublish += batch.size();
+
+                // Let inference see the updates every so often, each publish costs a copy of the layers on the next update
+                auto now = std::chrono::steady_clock::now();
+
+                if (sincePublish >= this->m_Options.publishEvery || now - lastPublish >= this->m_Options.publishInterval)
+                {
+                    this->m_Net.PublishWeights();
+                    this->m_Publishes.fetch_add(1, std::memory_order_relaxed);
+
+                    sincePublish = 0;
+                    lastPublish = now;
+                }
+            }
+            catch (...)
+            {
+                // Stop rather than letting the exception end the process, Flush and Stop report it
+                {
+                    auto scopedLock = std::scoped_lock(this->m_Lock);
+
+                    this->m_Failure = std::current_exception();
+                    this->m_Stopped = true;
+                    this->m_Busy = false;
+                    this->m_Queue.clear();
+                }
+
+                this->m_Popped.notify_all();
+
+                return;
+            }
+
+            batch.clear();
+
+            {
+                auto scopedLock = std::scoped_lock(this->m_Lock);
+
+                this->m_Busy = false;
+            }
+
+            this->m_Popped.notify_all();
+        }
+    }
+
+} // End namespace ai_assignment
@@ -0,0 +1,12 @@
+#pragma once
+#ifndef FWD_H_530093_SRC_STREAMING_TRAINER
+#define FWD_H_530093_SRC_STREAMING_TRAINER 1
+
+namespace ai_assignment
+{
+    class StreamingTrainer;
+
+} // End namespace ai_assignment
+
+
+#endif // FWD_H_530093_SRC_STREAMING_TRAINER
@@ -0,0 +1,211 @@
+#pragma once
+#ifndef H_530093_SRC_STREAMING_TRAINER
+#define H_530093_SRC_STREAMING_TRAINER 1
+
+#include "StreamingTrainer.fwd.hpp"
+#include "NeuralNet.fwd.hpp"
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <condition_variable>
+
+#include "NeuralNet.hpp"
+
+
+namespace ai_assignment
+{
+    /**
+     * @brief Trains a net online from a stream of examples on a background thread, holding at most a bounded queue of examples. Thread safe
+     */
+    class StreamingTrainer
+    {
+        public:
+
+            // Definitions
+
+            typedef NeuralNet::Example Example;
+
+            struct Options
+            {
+                double learningRate = 0.1;
+
+                /**
+                 * @brief The most examples waiting to be trained on, Push blocks once the queue is full
+                 */
+                size_t queueCapacity = 4096;
+
+                /**
+                 * @brief The most examples trained on per hold of the net's lock
+                 */
+                size_t batchSize = 32;
+
+                /**
+                 * @brief The weight of each new squared error in the exponentially weighted error, between 0 and 1
+                 */
+                double errorDecay = 0.01;
+
+                /**
+                 * @brief Publish the weights for inference after this many examples...
+                 */
+                size_t publishEvery = 1024;
+
+                /**
+                 * @brief ...or this long after the last publish, whichever comes first
+                 */
+                std::chrono::milliseconds publishInterval = std::chrono::milliseconds(1000);
+            };
+
+
+            // Constructors
+
+
+            /**
+             * @brief Start a background thread training the net. The net must outlive the trainer, and shouldn't be trained by anything else meanwhile
+             *
+             * @param net The net to train
+             * @param options How to train
+             */
+            StreamingTrainer(NeuralNet &net, const Options &options);
+
+            inline StreamingTrainer(NeuralNet &net)
+                : StreamingTrainer(net, Options())
+            {}
+
+            StreamingTrainer(const StreamingTrainer &obj) = delete;
+            StreamingTrainer &operator=(const StreamingTrainer &obj) = delete;
+
+            /**
+             * @brief Stops the background thread, dropping anything still queued. Call Flush first to train on it, and Stop to hear of any exception training threw
+             */
+            virtual ~StreamingTrainer() noexcept;
+
+            // Accessors
+
+            /**
+             * @brief The exponentially weighted mean squared error of the examples trained on so far
+             */
+            inline double Error() const noexcept
+            {
+                return this->m_Error.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * @brief The number of examples trained on so far
+             */
+            inline size_t ExamplesSeen() const noexcept
+            {
+                return this->m_ExamplesSeen.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * @brief The number of times the weights have been published
+             */
+            inline size_t Publishes() const noexcept
+            {
+                return this->m_Publishes.load(std::memory_order_relaxed);
+            }
+
+            // Functions
+
+            /**
+             * @brief Queue an example, waiting for room if the queue is full
+             *
+             * @return false if the trainer has been stopped
+             */
+            bool Push(Example example);
+
+            /**
+             * @brief Queue a batch of examples, waiting for room as needed
+             *
+             * @return false if the trainer was stopped before every example was queued
+             */
+            bool Push(std::vector<Example> &&examples);
+
+            /**
+             * @brief Queue an example if there's room
+             *
+             * @return false if the queue is full or the trainer has been stopped
+             */
+            bool TryPush(Example example);
+
+            /**
+             * @brief Wait until every queued example has been trained on, then publish the weights. Rethrows the exception which stopped training, if one did
+             */
+            void Flush();
+
+            /**
+             * @brief Stop training, dropping anything still queued. Later pushes fail. Rethrows the exception which stopped training, if one did
+             */
+            void Stop();
+
+        protected:
+
+            // Properties
+
+            NeuralNet &m_Net;
+
+            const Options m_Options;
+
+            /**
+             * @brief Examples waiting to be trained on
+             */
+            std::deque<Example> m_Queue;
+
+            /**
+             * @brief Whether the background thread is part way through a batch
+             */
+            bool m_Busy = false;
+
+            bool m_Stopped = false;
+
+            /**
+             * @brief The exception training threw, which stops the trainer
+             */
+            std::exception_ptr m_Failure = nullptr;
+
+            /**
+             * @brief A mutex to guard m_Queue, m_Busy, m_Stopped and m_Failure
+             */
+            std::mutex m_Lock;
+
+            /**
+             * @brief Signalled when examples are queued, or on stopping
+             */
+            std::condition_variable_any m_Pushed;
+
+            /**
+             * @brief Signalled when examples are taken off the queue, or on stopping
+             */
+            std::condition_variable_any m_Popped;
+
+            std::atomic<double> m_Error = 0.0;
+            std::atomic<size_t> m_ExamplesSeen = 0;
+            std::atomic<size_t> m_Publishes = 0;
+
+            /**
+             * @brief Started last, so everything it uses is ready
+             */
+            std::jthread m_Worker;
+
+            // Functions
+
+            /**
+             * @brief The background thread, trains on batches from the queue until stopped or training throws
+             */
+            void Run(std::stop_token stopToken);
+
+            /**
+             * @brief Stop training and join the background thread, without reporting failures
+             */
+            void Shutdown() noexcept;
+    };
+
+} // End namespace ai_assignment
+
+
+#endif // H_530093_SRC_STREAMING_TRAINER
@@ -0,0 +1,253 @@
+#include "Trace.hpp"
+
+#ifdef AI_ASSIGNMENT_TRACING
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <iomanip>
+#include <unistd.h>
+
+
+namespace ai_assignment::trace
+{
+    // Definitions
+
+    struct Event
+    {
+        const char *name;
+        const char *category;
+        int64_t start;
+        int64_t duration;
+        int64_t arg;
+    };
+
+    /**
+     * @brief The events of one thread. Only the owning thread writes, readers see events up to count
+     */
+    struct ThreadBuffer
+    {
+        size_t tid;
+        std::atomic<size_t> count;
+        std::unique_ptr<Event[]> events;
+
+        /**
+         * @brief Whether the thread has exited, guarded by g_BuffersLock. Once its events are written out the buffer goes to the next new thread
+         */
+        bool retired;
+    };
+
+    /**
+     * @brief The calling thread's buffer, handed back when the thread exits
+     */
+    struct ThreadRegistration
+    {
+        ThreadBuffer *buffer = nullptr;
+
+        /**
+         * @brief Whether we've asked for a buffer, so a thread which couldn't get one doesn't keep asking
+         */
+        bool attempted = false;
+
+        ~ThreadRegistration() noexcept;
+    };
+
+
+    // Globals
+
+    std::atomic<bool> g_Enabled = false;
+
+    static const auto g_Epoch = std::chrono::steady_clock::now();
+
+    static std::atomic<size_t> g_Dropped = 0;
+
+    /**
+     * @brief Every thread's buffer, kept after the thread exits until its events have been written out
+     */
+    static std::vector<std::unique_ptr<ThreadBuffer>> g_Buffers;
+
+    /**
+     * @brief The tid given to the last thread to take a buffer
+     */
+    static size_t g_LastTid = 0;
+
+    /**
+     * @brief A mutex to guard g_Buffers, only taken when a thread records its first event, when it exits and when reading
+     */
+    static std::mutex g_BuffersLock;
+
+    static thread_local ThreadRegistration t_Registration;
+
+
+    // Helpers
+
+    /**
+     * @brief Write a string literal as a JSON string
+     */
+    static void writeString(std::ostream &out, const char *str)
+    {
+        out << '"';
+
+        for (; *str != '\0'; str++)
+        {
+            if (*str == '"' || *str == '\\') out << '\\';
+
+            out << *str;
+        }
+
+        out << '"';
+    }
+
+    /**
+     * @brief Find the calling thread a buffer, reusing one whose thread has exited if we can
+     *
+     * @return ThreadBuffer* The buffer, or nullptr if they're all taken or we're out of memory
+     */
+    static ThreadBuffer *takeBuffer() noexcept
+    {
+        try
+        {
+            auto scopedLock = std::scoped_lock(g_BuffersLock);
+
+            for (auto &buffer : g_Buffers)
+            {
+                if (!buffer->retired || buffer->count.load(std::memory_order_relaxed) != 0) continue;
+
+                buffer->retired = false;
+                buffer->tid = ++g_LastTid;
+
+                return buffer.get();
+            }
+
+            if (g_Buffers.size() == MaxThreadBuffers) return nullptr;
+
+            auto buffer = std::unique_ptr<ThreadBuffer>(new ThreadBuffer{
+                .tid = g_LastTid + 1,
+                .count = 0,
+                .events = std::make_unique<Event[]>(EventsPerThread),
+                .retired = false
+            });
+
+            g_Buffers.push_back(std::move(buffer));
+
+            g_LastTid++;
+
+            return g_Buffers.back().get();
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    }
+
+    ThreadRegistration::~ThreadRegistration() noexcept
+    {
+        if (this->buffer == nullptr) return;
+
+        auto scopedLock = std::scoped_lock(g_BuffersLock);
+
+        this->buffer->retired = true;
+    }
+
+
+    // Functions
+
+    int64_t Now() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_Epoch).count();
+    }
+
+    void Record(const char *name, const char *category, int64_t start, int64_t duration, int64_t arg) noexcept
+    {
+        auto &registration = t_Registration;
+
+        // Register this thread on its first event
+        if (!registration.attempted)
+        {
+            registration.attempted = true;
+            registration.buffer = takeBuffer();
+        }
+
+        ThreadBuffer *buffer = registration.buffer;
+        size_t count = (buffer != nullptr)? buffer->count.load(std::memory_order_relaxed) : EventsPerThread;
+
+        if (count == EventsPerThread)
+        {
+            g_Dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        buffer->events[count] = { name, category, start, duration, arg };
+
+        // Publish the event to readers
+        buffer->count.store(count + 1, std::memory_order_release);
+    }
+
+    void WriteChromeTrace(std::ostream &out)
+    {
+        auto scopedLock = std::scoped_lock(g_BuffersLock);
+
+        auto pid = getpid();
+        bool first = true;
+
+        // Leave the caller's stream as we found it
+        auto flags = out.flags();
+        auto precision = out.precision();
+
+        out << "{\"traceEvents\":[";
+        out << std::fixed << std::setprecision(3);
+
+        for (auto &buffer : g_Buffers)
+        {
+            size_t count = buffer->count.load(std::memory_order_acquire);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                const auto &event = buffer->events[i];
+
+                if (!first) out << ',';
+                first = false;
+
+                // Complete ("X") events are timed in microseconds
+                out << "\n{\"name\":";
+                writeString(out, event.name);
+                out << ",\"cat\":";
+                writeString(out, event.category);
+                out << ",\"ph\":\"X\",\"ts\":" << event.start / 1000.0
+                    << ",\"dur\":" << event.duration / 1000.0
+                    << ",\"pid\":" << pid
+                    << ",\"tid\":" << buffer->tid;
+
+                if (event.arg >= 0) out << ",\"args\":{\"n\":" << event.arg << '}';
+
+                out << '}';
+            }
+
+            // The thread has gone, so its events are flushed and the buffer can be reused
+            if (buffer->retired) buffer->count.store(0, std::memory_order_relaxed);
+        }
+
+        out << "\n],\"displayTimeUnit\":\"ns\"}" << std::endl;
+
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+    void Clear() noexcept
+    {
+        auto scopedLock = std::scoped_lock(g_BuffersLock);
+
+        for (auto &buffer : g_Buffers) buffer->count.store(0, std::memory_order_relaxed);
+
+        g_Dropped.store(0, std::memory_order_relaxed);
+    }
+
+    size_t DroppedEvents() noexcept
+    {
+        return g_Dropped.load(std::memory_order_relaxed);
+    }
+
+} // End namespace ai_assignment::trace
+
+
+#endif // AI_ASSIGNMENT_TRACING
@@ -0,0 +1,182 @@
+#pragma once
+#ifndef H_530093_SRC_TRACE
+#define H_530093_SRC_TRACE 1
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+
+/**
+ * @brief Scoped timeline spans which can be dumped as Chrome trace_event JSON (open in Perfetto or chrome://tracing)
+ *
+ * Spans are compiled in when AI_ASSIGNMENT_TRACING is defined (the ENABLE_TRACING CMake option), and are otherwise empty classes the optimiser removes. When compiled in, a span costs one relaxed atomic load until tracing is enabled at runtime
+ */
+namespace ai_assignment::trace
+{
+    /**
+     * @brief The number of events each thread can buffer, later events are dropped
+     */
+    constexpr size_t EventsPerThread = 1 << 16;
+
+    /**
+     * @brief The most thread buffers kept at once. Threads which start once they're all taken have their events dropped
+     */
+    constexpr size_t MaxThreadBuffers = 64;
+
+#ifdef AI_ASSIGNMENT_TRACING
+
+    /**
+     * @brief Whether spans are being recorded, read on every span
+     */
+    extern std::atomic<bool> g_Enabled;
+
+    /**
+     * @brief Start or stop recording spans
+     */
+    inline void Enable(bool enabled = true) noexcept
+    {
+        g_Enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    inline bool IsEnabled() noexcept
+    {
+        return g_Enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Nanoseconds since the first call, shared by every thread
+     */
+    int64_t Now() noexcept;
+
+    /**
+     * @brief Append a finished span to the calling thread's buffer. Lock free once the thread has recorded its first event
+     *
+     * @param name A string literal (only the pointer is kept)
+     * @param category A string literal (only the pointer is kept)
+     * @param start When the span started, from Now()
+     * @param duration How long the span lasted in nanoseconds
+     * @param arg An optional value to attach to the event (e.g. the epoch or layer), negative values are left out
+     */
+    void Record(const char *name, const char *category, int64_t start, int64_t duration, int64_t arg) noexcept;
+
+    /**
+     * @brief Times the enclosing scope, or until End is called. Not thread safe (each thread uses its own)
+     */
+    class Span
+    {
+        public:
+
+            // Constructors
+
+            /**
+             * @brief Start the span if tracing is enabled
+             *
+             * @param name A string literal naming the span
+             * @param category A string literal grouping spans
+             * @param arg An optional value to attach to the event, negative values are left out
+             */
+            inline Span(const char *name, const char *category = "nn", int64_t arg = -1) noexcept
+                : m_Name(IsEnabled()? name : nullptr),
+                    m_Category(category),
+                    m_Arg(arg),
+                    m_Start(m_Name != nullptr? Now() : 0)
+            {}
+
+            Span(const Span &obj) = delete;
+            Span &operator=(const Span &obj) = delete;
+
+            inline ~Span() noexcept
+            {
+                this->End();
+            }
+
+            // Functions
+
+            /**
+             * @brief Finish the span early, later calls do nothing
+             */
+            inline void End() noexcept
+            {
+                if (this->m_Name == nullptr) return;
+
+                Record(this->m_Name, this->m_Category, this->m_Start, Now() - this->m_Start, this->m_Arg);
+
+                this->m_Name = nullptr;
+            }
+
+        protected:
+
+            // Properties
+
+            const char *m_Name;
+            const char *m_Category;
+            const int64_t m_Arg;
+            const int64_t m_Start;
+    };
+
+    /**
+     * @brief Write every buffered event as Chrome trace_event JSON. Spans still open are not included. The events of threads which have exited are only written once, then their buffer is handed to the next thread to start
+     */
+    void WriteChromeTrace(std::ostream &out);
+
+    /**
+     * @brief Discard every buffered event. Must not race with threads recording spans
+     */
+    void Clear() noexcept;
+
+    /**
+     * @brief The number of events dropped because a thread's buffer was full, or a thread couldn't get one
+     */
+    size_t DroppedEvents() noexcept;
+
+#else
+
+    inline void Enable(bool = true) noexcept
+    {}
+
+    inline bool IsEnabled() noexcept
+    {
+        return false;
+    }
+
+    /**
+     * @brief Compiled out, does nothing
+     */
+    class Span
+    {
+        public:
+
+            inline Span(const char *, const char * = "nn", int64_t = -1) noexcept
+            {}
+
+            Span(const Span &obj) = delete;
+            Span &operator=(const Span &obj) = delete;
+
+            inline void End() noexcept
+            {}
+    };
+
+    /**
+     * @brief Compiled out, writes an empty trace
+     */
+    inline void WriteChromeTrace(std::ostream &out)
+    {
+        out << "{\"traceEvents\":[]}" << std::endl;
+    }
+
+    inline void Clear() noexcept
+    {}
+
+    inline size_t DroppedEvents() noexcept
+    {
+        return 0;
+    }
+
+#endif // AI_ASSIGNMENT_TRACING
+
+} // End namespace ai_assignment::trace
+
+
+#endif // H_530093_SRC_TRACE
@@ -9,11 +9,14 @@ namespace ai_assignment
 {
     /**
      * @brief A data type to hold information on a training example
+     *
+     * @tparam T The type of the target output
+     * @tparam Input The type of the inputs, dense by default
      */
-    template<typename T>
+    template<typename T, typename Input = std::vector<double>>
     struct TrainingExample
     {
-        std::vector<double> inputs;
+        Input inputs;
         T targetOutput;
     };
 
@@ -0,0 +1,198 @@
+#include "TrainingJob.hpp"
+
+#include <limits>
+
+
+namespace ai_assignment
+{
+    // Public Constructors
+
+
+    TrainingJob::TrainingJob(NeuralNet &net, vector<Example> examples, const Options &options)
+        : m_Net(net),
+            m_Examples(std::move(examples)),
+            m_Options(options),
+            m_Result(m_Promise.get_future().share()),
+            m_Worker([this](std::stop_token stopToken) { this->Run(stopToken); })
+    {}
+
+    TrainingJob::~TrainingJob() noexcept
+    {
+        this->m_Worker.request_stop();
+
+        if (this->m_Worker.joinable()) this->m_Worker.join();
+    }
+
+
+    // Public Accessors
+
+
+    bool TrainingJob::Done() const
+    {
+        auto scopedLock = std::scoped_lock(this->m_Lock);
+
+        return this->m_Done;
+    }
+
+    std::optional<TrainingJob::Progress> TrainingJob::Latest() const
+    {
+        auto scopedLock = std::scoped_lock(this->m_Lock);
+
+        return this->m_Latest;
+    }
+
+
+    // Public Functions
+
+
+    std::optional<TrainingJob::Progress> TrainingJob::NextProgress()
+    {
+        auto lock = std::unique_lock(this->m_Lock);
+
+        this->m_Updated.wait(lock, [this]() { return this->m_Done || !this->m_Progress.empty(); });
+
+        if (this->m_Progress.empty()) return std::nullopt;
+
+        auto progress = this->m_Progress.front();
+        this->m_Progress.pop_front();
+
+        return progress;
+    }
+
+    std::optional<TrainingJob::Progress> TrainingJob::NextProgress(std::chrono::milliseconds timeout)
+    {
+        auto lock = std::unique_lock(this->m_Lock);
+
+        this->m_Updated.wait_for(lock, timeout, [this]() { return this->m_Done || !this->m_Progress.empty(); });
+
+        if (this->m_Progress.empty()) return std::nullopt;
+
+        auto progress = this->m_Progress.front();
+        this->m_Progress.pop_front();
+
+        return progress;
+    }
+
+    NeuralNet::weight_set_type TrainingJob::Checkpoint() const
+    {
+        auto scopedLock = std::scoped_lock(this->m_Lock);
+
+        return this->m_Checkpoint;
+    }
+
+    TrainingJob::Result TrainingJob::Wait() const
+    {
+        return this->m_Result.get();
+    }
+
+
+    // Protected Functions
+
+
+    void TrainingJob::Run(std::stop_token stopToken)
+    {
+        auto result = Result();
+        result.mse = std::numeric_limits<double>::quiet_NaN();
+
+        try
+        {
+            if (this->m_Examples.empty()) throw std::invalid_argument("Nothing to train on");
+
+            // Start from whatever the net has now
+            {
+                auto scopedLock = std::scoped_lock(this->m_Net.m_Lock);
+                auto checkpoint = this->m_Net.ShareWeights();
+
+                auto jobLock = std::scoped_lock(this->m_Lock);
+                this->m_Checkpoint = std::move(checkpoint);
+            }
+
+            double learningRate = this->m_Options.learningRate;
+            // Arbitrarily large, so the first epoch is never worse
+            double previousMSE = 1E300;
+
+            while (result.epochs < this->m_Options.maxEpochs)
+            {
+                if (stopToken.stop_requested())
+                {
+                    result.cancelled = true;
+                    break;
+                }
+
+                trace::Span epochSpan("epoch", "train", result.epochs + 1);
+
+                // Only hold the lock for the epoch, so snapshots and the like can get in between
+                trace::Span lockSpan("lock", "sync");
+                auto lock = std::unique_lock(this->m_Net.m_Lock);
+                lockSpan.End();
+
+                result.epochs++;
+
+                double mse;
+                auto checkpoint = this->Checkpoint();
+
+                // Epochs we're cancelled part way through (checked between examples, so long epochs don't hold it up), which make things worse, or which throw are rolled back
+                auto outcome = this->m_Net.RunCheckedEpoch(this->m_Examples, learningRate, checkpoint, previousMSE, this->m_Options.stopWhenWorse, mse, [&stopToken]() { return stopToken.stop_requested(); });
+
+                lock.unlock();
+
+                if (outcome == NeuralNet::EpochOutcome::Cancelled)
+                {
+                    result.cancelled = true;
+                    break;
+                }
+
+                if (outcome == NeuralNet::EpochOutcome::Worse)
+                {
+                    this->Report({ .epoch = result.epochs, .mse = mse, .committed = false });
+                    break;
+                }
+
+                // Keep the epoch, which inference is already using
+                {
+                    auto scopedLock = std::scoped_lock(this->m_Lock);
+                    this->m_Checkpoint = std::move(checkpoint);
+                }
+
+                result.mse = mse;
+                this->Report({ .epoch = result.epochs, .mse = mse, .committed = true });
+
+                // Continue until the mean squared error stops changing
+                if (mse == previousMSE) break;
+
+                previousMSE = mse;
+            }
+
+            {
+                auto scopedLock = std::scoped_lock(this->m_Lock);
+                this->m_Done = true;
+            }
+
+            this->m_Updated.notify_all();
+            this->m_Promise.set_value(result);
+        }
+        catch (...)
+        {
+            {
+                auto scopedLock = std::scoped_lock(this->m_Lock);
+                this->m_Done = true;
+            }
+
+            this->m_Updated.notify_all();
+            this->m_Promise.set_exception(std::current_exception());
+        }
+    }
+
+    void TrainingJob::Report(const Progress &progress)
+    {
+        {
+            auto scopedLock = std::scoped_lock(this->m_Lock);
+
+            this->m_Progress.push_back(progress);
+            this->m_Latest = progress;
+        }
+
+        this->m_Updated.notify_all();
+    }
+
+} // End namespace ai_assignment
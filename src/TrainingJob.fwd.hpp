@@ -0,0 +1,12 @@
+#pragma once
+#ifndef FWD_H_530093_SRC_TRAINING_JOB
+#define FWD_H_530093_SRC_TRAINING_JOB 1
+
+namespace ai_assignment
+{
+    class TrainingJob;
+
+} // End namespace ai_assignment
+
+
+#endif // FWD_H_530093_SRC_TRAINING_JOB
@@ -0,0 +1,231 @@
+#pragma once
+#ifndef H_530093_SRC_TRAINING_JOB
+#define H_530093_SRC_TRAINING_JOB 1
+
+#include "TrainingJob.fwd.hpp"
+#include "NeuralNet.fwd.hpp"
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+#include <optional>
+#include <stop_token>
+#include <condition_variable>
+
+#include "NeuralNet.hpp"
+
+
+namespace ai_assignment
+{
+    /**
+     * @brief Runs the epoch loop of NeuralNet::TrainNetwork on a background thread. The net's lock is only held for one epoch at a time, and inference carries on against the last committed epoch. Thread safe
+     */
+    class TrainingJob
+    {
+        public:
+
+            // Definitions
+
+            typedef NeuralNet::Example Example;
+
+            struct Options
+            {
+                double learningRate = 0.1;
+
+                /**
+                 * @brief Stop after this many epochs, as the assignment does
+                 */
+                size_t maxEpochs = 135;
+
+                /**
+                 * @brief Stop on an epoch which makes the error worse, rolling it back
+                 */
+                bool stopWhenWorse = true;
+            };
+
+            /**
+             * @brief Reported after every epoch
+             */
+            struct Progress
+            {
+                size_t epoch;
+
+                /**
+                 * @brief The mean squared error of the epoch
+                 */
+                double mse;
+
+                /**
+                 * @brief Whether the epoch was kept. Rolled back epochs end the job
+                 */
+                bool committed;
+            };
+
+            struct Result
+            {
+                /**
+                 * @brief The number of epochs run, including any rolled back or cut short
+                 */
+                size_t epochs = 0;
+
+                /**
+                 * @brief The mean squared error of the last committed epoch, or NaN if none were
+                 */
+                double mse = 0.0;
+
+                /**
+                 * @brief Whether the job stopped because it was asked to. The epoch it was part way through is rolled back
+                 */
+                bool cancelled = false;
+            };
+
+
+            // Constructors
+
+
+            /**
+             * @brief Start training the net on a background thread. The net must outlive the job, and shouldn't be trained by anything else meanwhile
+             *
+             * @param net The net to train
+             * @param examples The examples to train on, owned by the job
+             * @param options How to train
+             */
+            TrainingJob(NeuralNet &net, vector<Example> examples, const Options &options);
+
+            inline TrainingJob(NeuralNet &net, vector<Example> examples)
+                : TrainingJob(net, std::move(examples), Options())
+            {}
+
+            TrainingJob(const TrainingJob &obj) = delete;
+            TrainingJob &operator=(const TrainingJob &obj) = delete;
+
+            /**
+             * @brief Cancels the job and waits for it to stop
+             */
+            virtual ~TrainingJob() noexcept;
+
+            // Accessors
+
+            /**
+             * @brief The final result, or the exception the job stopped with. Can be waited on from any number of threads
+             */
+            inline std::shared_future<Result> GetResult() const noexcept
+            {
+                return this->m_Result;
+            }
+
+            /**
+             * @brief Can be handed to anything else which should be able to cancel the job
+             */
+            inline std::stop_source GetStopSource() noexcept
+            {
+                return this->m_Worker.get_stop_source();
+            }
+
+            /**
+             * @brief Whether the job has finished, successfully or not
+             */
+            bool Done() const;
+
+            /**
+             * @brief The progress of the last epoch, if there's been one
+             */
+            std::optional<Progress> Latest() const;
+
+            // Functions
+
+            /**
+             * @brief Wait for the next epoch's progress. Every epoch is reported exactly once across all callers
+             *
+             * @return The progress, or nothing once the job has finished and every epoch has been reported
+             */
+            std::optional<Progress> NextProgress();
+
+            /**
+             * @brief As NextProgress, but gives up after a timeout
+             *
+             * @return The progress, or nothing if the job has finished or the timeout passed first
+             */
+            std::optional<Progress> NextProgress(std::chrono::milliseconds timeout);
+
+            /**
+             * @brief The weights of the last committed epoch, shared rather than copied. Pass them to NeuralNet::Restore to go back to them later
+             */
+            NeuralNet::weight_set_type Checkpoint() const;
+
+            /**
+             * @brief Ask the job to stop. It rolls back the epoch it is part way through, then finishes with a cancelled result
+             */
+            inline void Cancel() noexcept
+            {
+                this->m_Worker.request_stop();
+            }
+
+            /**
+             * @brief Wait for the job to finish
+             */
+            Result Wait() const;
+
+        protected:
+
+            // Properties
+
+            NeuralNet &m_Net;
+
+            vector<Example> m_Examples;
+
+            const Options m_Options;
+
+            /**
+             * @brief Progress not yet taken by NextProgress
+             */
+            std::deque<Progress> m_Progress;
+
+            std::optional<Progress> m_Latest;
+
+            /**
+             * @brief The weights of the last committed epoch
+             */
+            NeuralNet::weight_set_type m_Checkpoint;
+
+            bool m_Done = false;
+
+            /**
+             * @brief A mutex to guard m_Progress, m_Latest, m_Checkpoint and m_Done
+             */
+            mutable std::mutex m_Lock;
+
+            /**
+             * @brief Signalled after every epoch, and when the job finishes
+             */
+            std::condition_variable m_Updated;
+
+            std::promise<Result> m_Promise;
+
+            std::shared_future<Result> m_Result;
+
+            /**
+             * @brief Started last, so everything it uses is ready
+             */
+            std::jthread m_Worker;
+
+            // Functions
+
+            /**
+             * @brief The background thread, trains until done or cancelled
+             */
+            void Run(std::stop_token stopToken);
+
+            /**
+             * @brief Record an epoch's progress and wake anyone waiting for it
+             */
+            void Report(const Progress &progress);
+    };
+
+} // End namespace ai_assignment
+
+
+#endif // H_530093_SRC_TRAINING_JOB
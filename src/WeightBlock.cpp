@@ -0,0 +1,23 @@
+#include "WeightBlock.hpp"
+
+#include <cstring>
+
+
+namespace ai_assignment
+{
+    // Public Constructors
+
+
+    WeightBlock::WeightBlock(std::shared_ptr<Arena> arena, size_t size)
+        : m_Arena(arena),
+            m_Size(size),
+            m_Data(arena->Allocate<double>(size))
+    {}
+
+    WeightBlock::WeightBlock(std::shared_ptr<Arena> arena, const WeightBlock &obj)
+        : WeightBlock(arena, obj.m_Size)
+    {
+        std::memcpy(this->m_Data, obj.m_Data, this->m_Size * sizeof(double));
+    }
+
+} // End namespace ai_assignment
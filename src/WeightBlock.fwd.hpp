@@ -0,0 +1,12 @@
+#pragma once
+#ifndef FWD_H_530093_SRC_WEIGHT_BLOCK
+#define FWD_H_530093_SRC_WEIGHT_BLOCK 1
+
+namespace ai_assignment
+{
+    class WeightBlock;
+
+} // End namespace ai_assignment
+
+
+#endif // FWD_H_530093_SRC_WEIGHT_BLOCK
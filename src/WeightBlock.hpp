@@ -0,0 +1,86 @@
+#pragma once
+#ifndef H_530093_SRC_WEIGHT_BLOCK
+#define H_530093_SRC_WEIGHT_BLOCK 1
+
+#include "WeightBlock.fwd.hpp"
+#include "Arena.fwd.hpp"
+
+#include <memory>
+#include <cstddef>
+
+#include "Arena.hpp"
+
+
+namespace ai_assignment
+{
+    /**
+     * @brief A block of weights living in an arena. Shared between nets by reference count, the block goes back to its arena when the last reference is dropped. Not thread safe
+     */
+    class WeightBlock
+    {
+        public:
+
+            // Constructors
+
+
+            /**
+             * @brief Allocate a new block from an arena, keeping the arena alive for as long as the block is
+             *
+             * @param arena The arena to allocate from
+             * @param size The number of weights in the block
+             */
+            WeightBlock(std::shared_ptr<Arena> arena, size_t size);
+
+            /**
+             * @brief Allocate a new block from an arena and copy another block's weights into it
+             *
+             * @param arena The arena to allocate from
+             * @param obj The block to copy
+             */
+            WeightBlock(std::shared_ptr<Arena> arena, const WeightBlock &obj);
+
+            // Blocks are shared through std::shared_ptr, never copied implicitly
+            WeightBlock(const WeightBlock &obj) = delete;
+            WeightBlock &operator=(const WeightBlock &obj) = delete;
+
+            /**
+             * @brief Give the block back to its arena
+             */
+            inline virtual ~WeightBlock() noexcept
+            {
+                this->m_Arena->Release(this->m_Data, this->m_Size * sizeof(double));
+            }
+
+            // Accessors
+
+            inline double *Data() const noexcept
+            {
+                return this->m_Data;
+            }
+
+            /**
+             * @brief The number of weights in the block
+             */
+            inline size_t Size() const noexcept
+            {
+                return this->m_Size;
+            }
+
+        protected:
+
+            // Properties
+
+            /**
+             * @brief The arena which owns our memory
+             */
+            const std::shared_ptr<Arena> m_Arena;
+
+            const size_t m_Size;
+
+            double *m_Data;
+    };
+
+} // End namespace ai_assignment
+
+
+#endif // H_530093_SRC_WEIGHT_BLOCK
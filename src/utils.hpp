@@ -5,6 +5,8 @@
 #include <vector>
 #include <iostream>
 
+#include "Executor.hpp"
+
 
 namespace ai_assignment::utils
 {
@@ -45,6 +47,30 @@ namespace ai_assignment::utils
         }
     }
 
+    /**
+     * @brief The number of threads to use when the caller asks for "as many as there are" (zero), the size of the shared executor
+     */
+    inline size_t threadCount(size_t requested = 0)
+    {
+        if (requested != 0) return requested;
+
+        return Executor::Default().ThreadCount();
+    }
+
+    /**
+     * @brief Calls fn(i) for every i in [0, count), spread over the shared executor's threads. Returns once every call has finished, then rethrows the first exception any call threw. Can be nested without oversubscribing
+     *
+     * @tparam Func Callable as fn(size_t)
+     * @param count The number of calls to make
+     * @param fn The function to call
+     * @param threads The most threads to use (including this one), zero uses every thread of the executor
+     */
+    template<typename Func>
+    inline void parallelFor(size_t count, Func fn, size_t threads = 0)
+    {
+        Executor::Default().ParallelFor(count, std::move(fn), threads);
+    }
+
 } // End namespace utils
 
 #endif // H_530093_SRC_UTILS
\ No newline at end of file